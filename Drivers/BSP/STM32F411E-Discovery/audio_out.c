@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "audio_out.h"
+
+
+static DMA_HandleTypeDef hdma_i2s_tx;
+
+
+/* Initialize the codec and the I2S peripheral */
+uint8_t audio_out_init(uint16_t output_device, uint8_t volume, uint32_t audio_freq) {
+  return BSP_AUDIO_OUT_Init(output_device, volume, audio_freq);
+}
+
+/* Start the circular transfer of the whole buffer. size is in bytes */
+uint8_t audio_out_play(int16_t *pbuffer, uint32_t size) {
+  /* The DMA counts 16-bit transfers */
+  if ((pbuffer == NULL) || ((size / AUDIODATA_SIZE) > DMA_MAX_SZE)) {
+    return AUDIO_ERROR;
+  }
+
+  return BSP_AUDIO_OUT_Play((uint16_t*)pbuffer, size);
+}
+
+/* Get the number of samples the DMA has left to read before it wraps
+   around to the start of the buffer */
+uint32_t audio_out_remaining(void) {
+  return __HAL_DMA_GET_COUNTER(&hdma_i2s_tx);
+}
+
+/* Same as the BSP's I2S MSP setup but with the DMA in circular mode */
+void BSP_AUDIO_OUT_MspInit(I2S_HandleTypeDef *hi2s, void *Params) {
+  GPIO_InitTypeDef gpio_init;
+
+  /* Enable I2S and GPIO clocks */
+  I2S3_CLK_ENABLE();
+  I2S3_SCK_SD_CLK_ENABLE();
+  I2S3_WS_CLK_ENABLE();
+  I2S3_MCK_CLK_ENABLE();
+
+  /* I2S3 pins configuration: SCK, SD, WS and MCK pins */
+  gpio_init.Pin = I2S3_SCK_PIN | I2S3_SD_PIN;
+  gpio_init.Mode = GPIO_MODE_AF_PP;
+  gpio_init.Pull = GPIO_NOPULL;
+  gpio_init.Speed = GPIO_SPEED_FAST;
+  gpio_init.Alternate = I2S3_SCK_SD_WS_AF;
+  HAL_GPIO_Init(I2S3_SCK_SD_GPIO_PORT, &gpio_init);
+
+  gpio_init.Pin = I2S3_WS_PIN;
+  HAL_GPIO_Init(I2S3_WS_GPIO_PORT, &gpio_init);
+
+  gpio_init.Pin = I2S3_MCK_PIN;
+  HAL_GPIO_Init(I2S3_MCK_GPIO_PORT, &gpio_init);
+
+  /* Enable the I2S DMA clock */
+  I2S3_DMAx_CLK_ENABLE();
+
+  if (hi2s->Instance == I2S3) {
+    hdma_i2s_tx.Init.Channel = I2S3_DMAx_CHANNEL;
+    hdma_i2s_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_i2s_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_i2s_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_i2s_tx.Init.PeriphDataAlignment = I2S3_DMAx_PERIPH_DATA_SIZE;
+    hdma_i2s_tx.Init.MemDataAlignment = I2S3_DMAx_MEM_DATA_SIZE;
+    hdma_i2s_tx.Init.Mode = DMA_CIRCULAR;
+    hdma_i2s_tx.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_i2s_tx.Init.FIFOMode = DMA_FIFOMODE_ENABLE;
+    hdma_i2s_tx.Init.FIFOThreshold = DMA_FIFO_THRESHOLD_FULL;
+    hdma_i2s_tx.Init.MemBurst = DMA_MBURST_SINGLE;
+    hdma_i2s_tx.Init.PeriphBurst = DMA_PBURST_SINGLE;
+    hdma_i2s_tx.Instance = I2S3_DMAx_STREAM;
+
+    /* Associate the DMA handle then configure the stream */
+    __HAL_LINKDMA(hi2s, hdmatx, hdma_i2s_tx);
+    HAL_DMA_DeInit(&hdma_i2s_tx);
+    HAL_DMA_Init(&hdma_i2s_tx);
+  }
+
+  /* I2S DMA IRQ channel configuration */
+  HAL_NVIC_SetPriority(I2S3_DMAx_IRQ, AUDIO_OUT_IRQ_PREPRIO, 0);
+  HAL_NVIC_EnableIRQ(I2S3_DMAx_IRQ);
+}
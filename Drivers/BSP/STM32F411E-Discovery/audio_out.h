@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __AUDIO_OUT_H
+#define __AUDIO_OUT_H
+
+#include "stm32f411e_discovery_audio.h"
+
+/* The audio output replaces the I2S MSP setup of the BSP so that the
+   DMA stream runs in circular mode. Once started with audio_out_play(),
+   the DMA keeps looping over the buffer on its own and the BSP's half
+   and full transfer callbacks only mark which half is free */
+
+uint8_t audio_out_init(uint16_t output_device, uint8_t volume, uint32_t audio_freq);
+uint8_t audio_out_play(int16_t *pbuffer, uint32_t size);
+uint32_t audio_out_remaining(void);
+
+#endif /* __AUDIO_OUT_H */
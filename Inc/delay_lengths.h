@@ -19,25 +19,35 @@
 #define __DELAY_LENGTHS_H
 
 #define MIDI_NOTE_OFFSET  108U
+#define NUM_OF_NOTES      88U
 
-/* Delay lengths for Karplus-Strong algorithm. Values are sorted so that
-   their index is related to the MIDI key number (with some offset). 
+/* The note tables are generated for the selected sample rate, reference
+   pitch and tuning system by Tools/gen_tables.c when the firmware is
+   built (see the Makefile). Every table is sorted so that the index is
+   related to the MIDI key number (with some offset).
 
    e.g. Pressing A4 on the digital piano will produce a MIDI message with
-   key number 69. The delay needed to produce A4 with the Karplus-Strong
-   algorithm will be at index (MIDI_NOTE_OFFSET - 69) = 39. */
-static const uint16_t note_delay_lengths[88] = {
-  10,   11,   11,   12,   13,   14,   14,   15,
-  16,   17,   18,   19,   21,   22,   23,   25,
-  26,   28,   29,   31,   33,   35,   37,   39,
-  42,   44,   47,   50,   53,   56,   59,   63,
-  66,   70,   75,   79,   84,   89,   94,   100,
-  106,  112,  119,  126,  133,  141,  150,  159,
-  168,  178,  189,  200,  212,  225,  238,  252,
-  267,  283,  300,  318,  337,  357,  378,  400,
-  424,  450,  476,  505,  535,  566,  600,  636,
-  674,  714,  756,  801,  849,  900,  953,  1010,
-  1070, 1133, 1201, 1272, 1348, 1428, 1513, 1603
-};
+   key number 69. The values needed to produce A4 with the Karplus-Strong
+   algorithm will be at index (MIDI_NOTE_OFFSET - 69) = 39.
+
+   note_delay_lengths  integer part of the loop delay. The stretching
+                       filter adds up to half a sample, so it is the
+                       integer part of (SAMPLE_FREQUENCY / f - S)
+   note_frac_coeffs    Q14 coefficient of the linear interpolation that
+                       makes up the fractional part of the loop delay
+   note_stretch_coeffs Q15 decay stretch factor S of the loop filter,
+                       from 0 (longest decay) to 16384 (plain average)
+   note_loss_coeffs    Q15 loop gain that sets the decay time
+   note_release_coeffs Q15 loop gain that sets the decay time once
+                       the key is released
+
+   note_bend_delays has a row for every key as well, indexed by the MSB
+   of the pitch wheel, that holds the Q14 loop delay D * 16384 + c of
+   the note bent to that position. The middle entry is the unbent delay */
+#include "note_tables.h"
+
+#if (NOTE_TABLES_SAMPLE_FREQUENCY != SAMPLE_FREQUENCY)
+#error "Note tables were generated for a different sample rate"
+#endif
 
 #endif /* __DELAY_LENGTHS_H */
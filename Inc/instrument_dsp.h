@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __INSTRUMENT_DSP_H
+#define __INSTRUMENT_DSP_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* Use the packed halfword instructions of the Cortex-M4 when they are
+   available. Otherwise, fall back to portable C that gives the same
+   output so the kernels can also be built and checked on a PC */
+#if defined(__ARM_FEATURE_SIMD32)
+#include "stm32f4xx.h"
+#define DSP_SIMD32
+#endif
+
+/* Shortest chunk worth processing with the vectorized loop */
+#define DSP_KS_MIN_CHUNK  32U
+
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE static inline
+#endif
+
+
+/* Read two samples with a single (possibly unaligned) 32-bit load */
+__STATIC_INLINE uint32_t dsp_read_pair(const int16_t *src) {
+  uint32_t pair;
+
+  memcpy(&pair, src, sizeof(pair));
+  return pair;
+}
+
+/* Write two samples with a single 32-bit store */
+__STATIC_INLINE void dsp_write_pair(int16_t *dst, uint32_t pair) {
+  memcpy(dst, &pair, sizeof(pair));
+}
+
+/* Bring a Q30 sum of products back to Q15, rounding towards zero. A
+   plain shift rounds down, which lets small negative values survive
+   the loop gain forever instead of dying out */
+__STATIC_INLINE int32_t dsp_q15_round(int32_t acc) {
+  return (acc + ((acc >> 31) & 0x7FFF)) >> 15;
+}
+
+/* Tap weights of the loop filter below. taps01 holds the weights of
+   y[n-D-2] (low half) and y[n-D-1] (high half), tap2 the weight of
+   y[n-D] in its low half. The high half of tap2 stays zero */
+typedef struct {
+  uint32_t taps01;
+  uint32_t tap2;
+} KsCoeffs;
+
+/* Combine the loop filter of the extended Karplus-Strong algorithm into
+   three Q15 tap weights. The decay stretching filter (1 - S) + S z^-1
+   and the linear interpolation (1 - c) + c z^-1 are convolved and scaled
+   by the loop gain g, where S is the Q15 stretch factor (at most one
+   half), c is the Q14 fractional delay coefficient and g is the Q15 loop
+   gain. The middle weight takes the rounding so that the weights add up
+   to exactly g, which is less than one */
+__STATIC_INLINE KsCoeffs dsp_ks_coeffs(uint16_t frac_coeff, uint16_t stretch_coeff, uint16_t loss_coeff) {
+  uint32_t weight0 = (((16384U - frac_coeff) * (32768U - stretch_coeff)) >> 14) * loss_coeff >> 15;
+  uint32_t weight2 = (((uint32_t)frac_coeff * (uint32_t)stretch_coeff) >> 14) * loss_coeff >> 15;
+  uint32_t weight1 = (uint32_t)loss_coeff - weight0 - weight2;
+  KsCoeffs coeffs;
+
+  coeffs.taps01 = weight2 | (weight1 << 16);
+  coeffs.tap2 = weight0;
+  return coeffs;
+}
+
+/* Extended Karplus-Strong loop filter for a single sample. taps points
+   to y[n-D-2]:
+   y[n] = ( w2 * y[n-D-2] + w1 * y[n-D-1] + w0 * y[n-D] ) >> 15
+   The weights add up to less than one, so the result can never overflow,
+   and the shift rounds towards zero so that the loop decays to silence */
+__STATIC_INLINE int16_t dsp_ks_frac(const int16_t *taps, KsCoeffs coeffs) {
+  return (int16_t)dsp_q15_round((int32_t)taps[0] * (int32_t)(coeffs.taps01 & 0xFFFFU) +
+                                (int32_t)taps[1] * (int32_t)(coeffs.taps01 >> 16) +
+                                (int32_t)taps[2] * (int32_t)coeffs.tap2);
+}
+
+/* Same as dsp_ks_frac but for two samples at once. The low half of the
+   result is y[n] and the high half is y[n+1]. Only valid when D >= 2 so
+   that y[n+1] does not depend on y[n] */
+__STATIC_INLINE uint32_t dsp_ks_frac2(const int16_t *taps, KsCoeffs coeffs) {
+#if defined(DSP_SIMD32)
+  uint32_t taps23 = dsp_read_pair(taps + 2);
+  /* The swapped multiply picks y[n-D+1] against the weight of y[n-D] */
+  int32_t result1 = dsp_q15_round((int32_t)__SMLAD(dsp_read_pair(taps), coeffs.taps01,
+                                                   __SMUAD(taps23, coeffs.tap2)));
+  int32_t result2 = dsp_q15_round((int32_t)__SMLAD(dsp_read_pair(taps + 1), coeffs.taps01,
+                                                   __SMUADX(taps23, coeffs.tap2)));
+
+  return __PKHBT(result1, result2, 16);
+#else
+  uint16_t result1 = (uint16_t)dsp_ks_frac(taps, coeffs);
+  uint16_t result2 = (uint16_t)dsp_ks_frac(taps + 1, coeffs);
+
+  return (uint32_t)result1 | ((uint32_t)result2 << 16);
+#endif
+}
+
+/* Apply the Karplus-Strong LPF to a chunk of samples that do not
+   depend on each other */
+__STATIC_INLINE void dsp_ks_chunk(int16_t *restrict out, const int16_t *restrict taps,
+                                  uint32_t count, KsCoeffs coeffs) {
+  uint32_t i;
+
+  for (i = 0; i < count; ++i) {
+    out[i] = dsp_ks_frac(&taps[i], coeffs);
+  }
+}
+
+/* Apply the Karplus-Strong LPF to a contiguous run of the delay line.
+   taps points to y[n-D-2] for the first output and neither out nor the
+   taps may wrap around the end of the delay line within the run.
+
+   Since y[n] only depends on y[n-D] down to y[n-D-2], the outputs of a
+   chunk of at most D samples never depend on each other. The run is
+   processed in chunks of up to chunk_len samples so the inner loop can be
+   vectorized. chunk_len must not exceed the distance between out and the
+   taps */
+__STATIC_INLINE void dsp_ks_run(int16_t *out, const int16_t *taps, uint32_t count,
+                                uint32_t chunk_len, KsCoeffs coeffs) {
+#if !defined(DSP_SIMD32)
+  uint32_t chunk;
+
+  /* Chunks that are too short cost more in loop overhead than they gain */
+  if (chunk_len >= DSP_KS_MIN_CHUNK) {
+    while (count > 0) {
+      chunk = (count < chunk_len) ? count : chunk_len;
+      dsp_ks_chunk(out, taps, chunk, coeffs);
+      out += chunk;
+      taps += chunk;
+      count -= chunk;
+    }
+    return;
+  }
+#else
+  (void)chunk_len;
+#endif
+
+  if ((((uintptr_t)out & 0x2U) != 0) && (count > 0)) {
+    /* Align the output for the 32-bit stores */
+    *out++ = dsp_ks_frac(taps, coeffs);
+    ++taps;
+    --count;
+  }
+
+  while (count >= 2) {
+    dsp_write_pair(out, dsp_ks_frac2(taps, coeffs));
+    out += 2;
+    taps += 2;
+    count -= 2;
+  }
+
+  if (count > 0) {
+    *out = dsp_ks_frac(taps, coeffs);
+  }
+}
+
+/* Add two samples and clip the result instead of wrapping around */
+__STATIC_INLINE int16_t dsp_mix(int16_t sample1, int16_t sample2) {
+  int32_t result = (int32_t)sample1 + (int32_t)sample2;
+
+  if (result > INT16_MAX) {
+    result = INT16_MAX;
+  } else if (result < INT16_MIN) {
+    result = INT16_MIN;
+  }
+  return (int16_t)result;
+}
+
+/* Add a run of samples to a mono mix with saturation */
+__STATIC_INLINE void dsp_mix_run(int16_t *mix, const int16_t *src, uint32_t count) {
+#if defined(DSP_SIMD32)
+  if ((((uintptr_t)mix & 0x2U) != 0) && (count > 0)) {
+    /* Align the mix for the 32-bit loads and stores */
+    *mix = (int16_t)__SSAT((int32_t)*mix + (int32_t)*src, 16);
+    ++mix;
+    ++src;
+    --count;
+  }
+
+  while (count >= 2) {
+    dsp_write_pair(mix, __QADD16(dsp_read_pair(mix), dsp_read_pair(src)));
+    mix += 2;
+    src += 2;
+    count -= 2;
+  }
+
+  if (count > 0) {
+    *mix = (int16_t)__SSAT((int32_t)*mix + (int32_t)*src, 16);
+  }
+#else
+  uint32_t i;
+
+  for (i = 0; i < count; ++i) {
+    mix[i] = dsp_mix(mix[i], src[i]);
+  }
+#endif
+}
+
+/* Copy a span of samples scaled by a Q15 gain */
+__STATIC_INLINE void dsp_scale_run(int16_t *restrict dst, const int16_t *restrict src, uint32_t count,
+                                   uint16_t gain) {
+#if defined(DSP_SIMD32)
+  uint32_t pair;
+  int32_t result1;
+  int32_t result2;
+
+  /* The high half of the gain word is zero, so each dual multiply
+     keeps a single product */
+  while (count >= 2) {
+    pair = dsp_read_pair(src);
+    result1 = (int32_t)__SMUAD(pair, gain) >> 15;
+    result2 = (int32_t)__SMUADX(pair, gain) >> 15;
+    dsp_write_pair(dst, __PKHBT(result1, result2, 16));
+    src += 2;
+    dst += 2;
+    count -= 2;
+  }
+
+  if (count > 0) {
+    *dst = (int16_t)(((int32_t)*src * (int32_t)gain) >> 15);
+  }
+#else
+  uint32_t i;
+
+  for (i = 0; i < count; ++i) {
+    dst[i] = (int16_t)(((int32_t)src[i] * (int32_t)gain) >> 15);
+  }
+#endif
+}
+
+/* Copy a span of samples through the feed-forward comb
+   ( x[n] - x[n-K] ) / 2, scaled by a Q15 gain. delayed points to x[n-K]
+   for the first sample. Halving the difference keeps the gain of the
+   comb at most one */
+__STATIC_INLINE void dsp_comb_run(int16_t *restrict dst, const int16_t *src, const int16_t *delayed,
+                                  uint32_t count, uint16_t gain) {
+#if defined(DSP_SIMD32)
+  uint32_t pair;
+  int32_t result1;
+  int32_t result2;
+
+  while (count >= 2) {
+    pair = __SHSUB16(dsp_read_pair(src), dsp_read_pair(delayed));
+    result1 = (int32_t)__SMUAD(pair, gain) >> 15;
+    result2 = (int32_t)__SMUADX(pair, gain) >> 15;
+    dsp_write_pair(dst, __PKHBT(result1, result2, 16));
+    src += 2;
+    delayed += 2;
+    dst += 2;
+    count -= 2;
+  }
+
+  if (count > 0) {
+    *dst = (int16_t)(((((int32_t)*src - (int32_t)*delayed) >> 1) * (int32_t)gain) >> 15);
+  }
+#else
+  uint32_t i;
+
+  for (i = 0; i < count; ++i) {
+    dst[i] = (int16_t)(((((int32_t)src[i] - (int32_t)delayed[i]) >> 1) * (int32_t)gain) >> 15);
+  }
+#endif
+}
+
+/* Check if any sample in a span reaches a level. The scan stops at
+   the first one that does, so loud spans cost almost nothing */
+__STATIC_INLINE uint8_t dsp_level_run(const int16_t *src, uint32_t count, int32_t level) {
+  while (count--) {
+    if ((*src >= level) || (*src <= -level)) {
+      return 1;
+    }
+    ++src;
+  }
+
+  return 0;
+}
+
+/* Advance a xorshift32 generator and return its new state. The state
+   must never be zero */
+__STATIC_INLINE uint32_t dsp_xorshift32(uint32_t *state) {
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  return x;
+}
+
+/* Fill a span with white noise over the whole signed 16-bit range.
+   Each output of the generator gives two samples and is written with
+   a single 32-bit store */
+__STATIC_INLINE void dsp_noise_run(int16_t *dst, uint32_t count, uint32_t *state) {
+  while (count >= 2) {
+    dsp_write_pair(dst, dsp_xorshift32(state));
+    dst += 2;
+    count -= 2;
+  }
+
+  if (count > 0) {
+    *dst = (int16_t)dsp_xorshift32(state);
+  }
+}
+
+/* Copy a mono mix into both channels of interleaved stereo frames,
+   writing every frame with a single 32-bit store */
+__STATIC_INLINE void dsp_stereo_expand(int16_t *restrict out, const int16_t *restrict mono, uint32_t frames) {
+#if defined(DSP_SIMD32)
+  uint32_t pair;
+
+  while (frames >= 2) {
+    pair = dsp_read_pair(mono);
+    dsp_write_pair(out, __PKHBT(pair, pair, 16));
+    dsp_write_pair(out + 2, __PKHTB(pair, pair, 16));
+    mono += 2;
+    out += 4;
+    frames -= 2;
+  }
+
+  if (frames > 0) {
+    out[0] = *mono;
+    out[1] = *mono;
+  }
+#else
+  uint32_t frame;
+  uint32_t i;
+
+  for (i = 0; i < frames; ++i) {
+    frame = (uint16_t)mono[i];
+    dsp_write_pair(&out[2 * i], frame | (frame << 16));
+  }
+#endif
+}
+
+#endif /* __INSTRUMENT_DSP_H */
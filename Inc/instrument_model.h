@@ -22,10 +22,53 @@
 #include <stdint.h>
 #include <string.h>
 #include "stm32f411e_discovery.h"
+#include "instrument_dsp.h"
 
 #define AUDIO_CHANNELS     2U
-#define AUDIO_BUFFER_SIZE  4096U
-#define MAX_AMPLITUDE      32760.0f
+#define MAX_VOICES         8U
+
+#if (MAX_VOICES > 32U)
+#error "Sustained voices are kept in a 32-bit mask"
+#endif
+
+/* A voice is freed once its level stays below one of these for as
+   many frames as its loop delay, so that nothing louder is left in the
+   delay line to come around again, and for at least a period. Released
+   voices use the higher level (about -60 dBFS) and held voices the
+   lower one (about -78 dBFS), where the loop is only left with
+   rounding noise */
+#define RELEASE_THRESHOLD  32
+#define SILENCE_THRESHOLD  4
+
+/* Positions of the 14-bit pitch wheel. The bend tables have an entry
+   for every value of the MSB plus one for the top end */
+#define BEND_CENTER        8192U
+#define BEND_MAX           16383U
+#define BEND_STEPS         128U
+
+/* Default seed for picking excitation bursts */
+#define INSTRUMENT_SEED    8675309U
+
+/* Number of frames in one half of the ping-pong buffer. This is the
+   amount rendered per call and sets the output latency, so it is kept
+   separate from the length of the delay lines. Normally set by the
+   Makefile */
+#ifndef AUDIO_PERIOD_SIZE
+#define AUDIO_PERIOD_SIZE  128U
+#endif
+#define AUDIO_BUFFER_SIZE  (2U * AUDIO_PERIOD_SIZE)
+
+/* Length of every voice's delay line. Must be a power of 2 that is
+   at least the longest delay plus four */
+#define DELAY_LINE_SIZE    2048U
+
+#if (AUDIO_PERIOD_SIZE < 32U) || (AUDIO_PERIOD_SIZE > 2048U) || \
+    ((AUDIO_PERIOD_SIZE & (AUDIO_PERIOD_SIZE - 1U)) != 0U)
+#error "AUDIO_PERIOD_SIZE must be a power of 2 between 32 and 2048"
+#endif
+#if ((DELAY_LINE_SIZE & (DELAY_LINE_SIZE - 1U)) != 0U)
+#error "DELAY_LINE_SIZE must be a power of 2"
+#endif
 
 /* Enum to tracking which buffer section
    has been processed */
@@ -48,20 +91,74 @@ typedef struct {
   uint16_t rw_index;
 } ModelMemory;
 
+/* Structure for a single Karplus-Strong voice.
+   Every voice owns its own delay line */
+typedef struct {
+  uint8_t active;
+  uint8_t idle;
+  uint8_t released;
+  uint8_t note;
+  uint16_t quiet_frames;
+  uint16_t max_delay;
+  uint16_t frac_coeff;
+  uint16_t stretch_coeff;
+  uint16_t loss_coeff;
+  uint16_t release_coeff;
+  uint16_t bend;
+  const uint32_t *bend_delays;
+  KsCoeffs coeffs;
+  uint32_t rand_state;
+  const int16_t *burst_p;
+  uint16_t burst_gain;
+  uint16_t burst_index;
+  uint16_t burst_left;
+  uint16_t burst_comb;
+  uint16_t burst_plain;
+  ModelMemory memory;
+} InstrumentVoice;
+
 /* Structure for storing the instrument
    model's properties */
 typedef struct {
   int16_t *audio_p;
   uint16_t buffer_len;
-  uint16_t max_delay;
-  ModelMemory memory;
+  InstrumentVoice voices[MAX_VOICES];
+  uint8_t next_voice;
   BufferSection section_done;
+  BufferSection section_busy;
+  int16_t *section_p;
+  int16_t *mix_p;
+  uint32_t block_offset;
+  uint32_t start_cycles;
+  uint32_t block_cycles;
+  uint32_t block_voices;
+  uint32_t note_on_cycles;
+  uint32_t skipped_voice_blocks;
+  uint32_t mix_load;
+  uint16_t pick_position;
+  uint8_t sustain;
+  uint32_t sustained_voices;
+  uint16_t bend;
+  uint8_t silent_sections;
+  uint8_t block_silent;
 } InstrumentModel;
 
 extern volatile BufferSection section_ready;
 
-InstrumentStatus instrument_model_init(InstrumentModel *model, uint16_t delay);
+InstrumentStatus instrument_model_init(InstrumentModel *model);
+InstrumentStatus instrument_model_seed(InstrumentModel *model, uint32_t seed);
+InstrumentStatus instrument_model_pick(InstrumentModel *model, uint16_t position);
+InstrumentStatus instrument_model_sustain(InstrumentModel *model, uint8_t pedal_down);
+InstrumentStatus instrument_model_bend(InstrumentModel *model, uint16_t position);
+uint8_t instrument_model_pending(InstrumentModel *model);
+InstrumentStatus instrument_model_begin(InstrumentModel *model);
+InstrumentStatus instrument_model_render_to(InstrumentModel *model, uint32_t offset);
+InstrumentStatus instrument_model_end(InstrumentModel *model);
 InstrumentStatus instrument_model_process(InstrumentModel *model);
-InstrumentStatus instrument_model_change(InstrumentModel *model, uint16_t delay);
+InstrumentStatus instrument_model_note_on(InstrumentModel *model, uint8_t note, uint8_t velocity,
+                                         uint16_t delay, uint16_t frac_coeff, uint16_t stretch_coeff,
+                                         uint16_t loss_coeff, const uint32_t *bend_delays);
+InstrumentStatus instrument_model_note_off(InstrumentModel *model, uint8_t note, uint16_t release_coeff);
+uint32_t instrument_model_voice_cycles(InstrumentModel *model);
 
 #endif /* __INSTRUMENT_MODEL_H */
@@ -20,18 +20,53 @@
 
 #include "usbh_core.h"
 #include "usbh_midi.h"
-#include "stm32f411e_discovery_audio.h"
+#include "audio_out.h"
 #include "instrument_model.h"
+#include "midi_queue.h"
+#include "midi_decoder.h"
+#include "midi_out_queue.h"
 
 #define AUDIO_VOLUME      70U
-#define SAMPLE_FREQUENCY  44100U
-#define RX_BUFFER_SIZE    64U
 
-extern uint8_t midi_rx_buffer[RX_BUFFER_SIZE];
+/* Each receive buffer holds a batch of full packets read back to back,
+   as many events as fit in the MIDI queue */
+#define RX_BUFFER_SIZE    (MIDI_QUEUE_SIZE * 4U)
+#define RX_BUFFERS        2U
+
+/* Cable and channels (bit n for channel n + 1) the instrument listens
+   to. All channels by default */
+#define MIDI_CABLE             0U
+#define MIDI_CHANNEL_MASK      0xFFFFU
+
+/* General purpose controller that sets the pick position, from the
+   bridge (0, which turns the comb off) to the middle of the string */
+#define MIDI_CC_PICK_POSITION  16U
+
+/* Damper pedal. Values from 64 up hold the released keys */
+#define MIDI_CC_SUSTAIN        64U
+
+/* Set to 1 to send the messages the instrument plays back to the
+   device, for keyboards with local control turned off */
+#ifndef MIDI_THRU
+#define MIDI_THRU              0
+#endif
+
+/* Normally set by the Makefile together with the note tables */
+#ifndef SAMPLE_FREQUENCY
+#define SAMPLE_FREQUENCY  44100U
+#endif
 
 extern void error_handler(void);
 
 void instrument_player_init(void);
+void instrument_player_start_midi(USBH_HandleTypeDef *phost);
+void instrument_player_stop_midi(void);
+MidiQueueStatus instrument_player_send(const MIDI_Packet *packet);
 void instrument_player_play(void);
+uint32_t instrument_player_late_periods(void);
+uint32_t instrument_player_dropped_events(void);
+uint32_t instrument_player_filtered_packets(void);
+uint32_t instrument_player_queued_out_packets(void);
+uint32_t instrument_player_dropped_out_packets(void);
 
 #endif /* __INSTRUMENT_PLAYER_H */
\ No newline at end of file
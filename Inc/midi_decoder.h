@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MIDI_DECODER_H
+#define __MIDI_DECODER_H
+
+#include <stdint.h>
+#include "usbh_midi.h"
+#include "midi_queue.h"
+
+/* Bit of a code index number in a type mask */
+#define MIDI_TYPE_BIT(CIN)  (1U << (CIN))
+
+/* Turns USB-MIDI packets into the channel messages that the
+   application asked for. Packets from other cables, channels or of
+   other types are counted and dropped, and so is the real-time traffic
+   (clock, active sensing, ...) that many instruments send without
+   being asked */
+typedef struct {
+  uint8_t cable;
+  uint16_t channel_mask;
+  uint16_t type_mask;
+  uint32_t decoded;
+  uint32_t filtered;
+  uint32_t realtime;
+  uint32_t invalid;
+} MidiDecoder;
+
+void midi_decoder_init(MidiDecoder *decoder, uint8_t cable, uint16_t channel_mask, uint16_t type_mask);
+uint8_t midi_decoder_decode(MidiDecoder *decoder, const MIDI_Packet *packet, MidiEvent *event);
+
+#endif /* __MIDI_DECODER_H */
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MIDI_OUT_QUEUE_H
+#define __MIDI_OUT_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "usbh_midi.h"
+#include "midi_queue.h"
+
+/* Must be a power of 2 */
+#define MIDI_OUT_QUEUE_SIZE   64U
+
+/* Largest full-speed bulk packet. Endpoints with smaller packets get
+   each transfer in chunks from the driver */
+#define MIDI_OUT_PACKET_SIZE  64U
+
+#if ((MIDI_OUT_QUEUE_SIZE & (MIDI_OUT_QUEUE_SIZE - 1U)) != 0U)
+#error "MIDI_OUT_QUEUE_SIZE must be a power of 2"
+#endif
+
+/* Ring of USB-MIDI packets waiting to be sent to the device. It is
+   only used from the main loop, like the USB host itself, so unlike
+   MidiQueue it needs no barriers. A control change that is still
+   waiting is updated in place by a newer value for the same
+   controller instead of taking another slot. Packed packets are
+   in_flight until their transfer is complete */
+typedef struct {
+  MIDI_Packet packets[MIDI_OUT_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t in_flight;
+  uint32_t sent;
+  uint32_t coalesced;
+  uint32_t dropped;
+  uint32_t max_depth;
+} MidiOutQueue;
+
+void midi_out_queue_init(MidiOutQueue *queue);
+MidiQueueStatus midi_out_queue_push(MidiOutQueue *queue, const MIDI_Packet *packet);
+uint16_t midi_out_queue_pack(MidiOutQueue *queue, uint8_t *buffer, uint16_t size);
+void midi_out_queue_complete(MidiOutQueue *queue);
+void midi_out_queue_clear(MidiOutQueue *queue);
+uint32_t midi_out_queue_depth(MidiOutQueue *queue);
+
+#endif /* __MIDI_OUT_QUEUE_H */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __MIDI_QUEUE_H
+#define __MIDI_QUEUE_H
+
+#include <stdint.h>
+
+/* Must be a power of 2 */
+#define MIDI_QUEUE_SIZE  64U
+
+#if ((MIDI_QUEUE_SIZE & (MIDI_QUEUE_SIZE - 1U)) != 0U)
+#error "MIDI_QUEUE_SIZE must be a power of 2"
+#endif
+
+typedef enum {
+  MIDI_QUEUE_OK,
+  MIDI_QUEUE_EMPTY,
+  MIDI_QUEUE_FULL
+} MidiQueueStatus;
+
+/* Structure for a decoded MIDI channel message. type holds
+   the code index number of the USB-MIDI packet and timestamp
+   the output frame at which the message was received */
+typedef struct {
+  uint32_t timestamp;
+  uint8_t type;
+  uint8_t channel;
+  uint8_t data1;
+  uint8_t data2;
+} MidiEvent;
+
+/* Single-producer/single-consumer ring of MIDI events. head is
+   only written by the producer and tail only by the consumer,
+   so neither side needs to lock the other out. Both indices run
+   freely and are masked when the ring is accessed */
+typedef struct {
+  MidiEvent events[MIDI_QUEUE_SIZE];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+  volatile uint32_t max_depth;
+} MidiQueue;
+
+void midi_queue_init(MidiQueue *queue);
+MidiQueueStatus midi_queue_push(MidiQueue *queue, const MidiEvent *event);
+MidiQueueStatus midi_queue_peek(MidiQueue *queue, MidiEvent *event);
+MidiQueueStatus midi_queue_pop(MidiQueue *queue, MidiEvent *event);
+uint32_t midi_queue_depth(MidiQueue *queue);
+
+#endif /* __MIDI_QUEUE_H */
@@ -24,6 +24,9 @@
 #define USB_MIDISTREAMING_SUBCLASS  0x03
 #define USBH_MIDI_CLASS             &midi_class
 
+/* Largest bulk packet at full speed */
+#define USBH_MIDI_MAX_PACKET_SIZE   64U
+
 #define GET_CN(HDR)   ((uint8_t)(HDR) >> 0x4U)
 #define GET_CIN(HDR)  ((uint8_t)(HDR) & 0xFU)
 
@@ -99,6 +102,10 @@ typedef struct {
   uint8_t               *rx_data_p;
   uint16_t              tx_data_length;
   uint16_t              rx_data_length;
+  uint16_t              rx_data_count;
+  uint32_t              rx_frame;
+  uint8_t               rx_armed;
+  uint8_t               rx_packet[USBH_MIDI_MAX_PACKET_SIZE];
   MIDI_DataStateTypeDef tx_data_state;
   MIDI_DataStateTypeDef rx_data_state;
 } MIDI_HandleTypeDef;
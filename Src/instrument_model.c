@@ -16,15 +16,30 @@
  */
 
 #include "instrument_model.h"
+#include "instrument_dsp.h"
+#include "excitation_bursts.h"
+
+#if (EXCITATION_LENGTH < (DELAY_LINE_SIZE - 4))
+#error "Excitation bursts are shorter than the longest delay"
+#endif
+#if ((EXCITATION_VARIANTS & (EXCITATION_VARIANTS - 1U)) != 0U)
+#error "EXCITATION_VARIANTS must be a power of 2"
+#endif
 
 
 volatile BufferSection section_ready = BUFFER_SECTION_NONE;
 static int16_t audio_buffer[AUDIO_CHANNELS * AUDIO_BUFFER_SIZE];
-static int16_t mem_buffer[AUDIO_BUFFER_SIZE / 2];
+static int16_t mem_buffer[MAX_VOICES][DELAY_LINE_SIZE];
+#if (AUDIO_CHANNELS == 2)
+static int16_t mix_buffer[AUDIO_PERIOD_SIZE];
+#endif
 
 
 /* Check if instrument model handle is valid then initialize values */
-InstrumentStatus instrument_model_init(InstrumentModel *model, uint16_t delay) {
+InstrumentStatus instrument_model_init(InstrumentModel *model) {
+  InstrumentVoice *voice;
+  uint32_t i;
+
   if (model == NULL) {
     return INSTRUMENT_ERROR;
   }
@@ -32,102 +47,589 @@ InstrumentStatus instrument_model_init(InstrumentModel *model, uint16_t delay) {
   /* Initialize values for instrument */
   model->audio_p = &audio_buffer[0];
   model->buffer_len = sizeof(audio_buffer) / sizeof(int16_t);
-  model->max_delay = delay;
+  model->next_voice = 0;
   model->section_done = BUFFER_SECTION_NONE;
+  model->section_busy = BUFFER_SECTION_NONE;
+  model->section_p = NULL;
+  model->mix_p = NULL;
+  model->block_offset = 0;
+  model->start_cycles = 0;
+  model->block_cycles = 0;
+  model->block_voices = 0;
+  model->note_on_cycles = 0;
+  model->skipped_voice_blocks = 0;
+  model->mix_load = 0;
+  model->pick_position = 0;
+  model->sustain = 0;
+  model->sustained_voices = 0;
+  model->bend = BEND_CENTER;
+  model->silent_sections = 0;
+  model->block_silent = 0;
+
+  /* Initialize values for each voice's memory (circular) buffer */
+  for (i = 0; i < MAX_VOICES; ++i) {
+    voice = &model->voices[i];
+    voice->active = 0;
+    voice->idle = 0;
+    voice->released = 0;
+    voice->note = 0;
+    voice->quiet_frames = 0;
+    voice->max_delay = 0;
+    voice->frac_coeff = 0;
+    voice->stretch_coeff = 0;
+    voice->loss_coeff = 0;
+    voice->release_coeff = 0;
+    voice->bend = BEND_CENTER;
+    voice->bend_delays = NULL;
+    voice->coeffs = dsp_ks_coeffs(0, 0, 0);
+    voice->memory.mem_p = &mem_buffer[i][0];
+    voice->memory.mem_len = sizeof(mem_buffer[i]) / sizeof(int16_t);
+    voice->memory.rw_index = 0;
+    voice->burst_p = NULL;
+    voice->burst_gain = 0;
+    voice->burst_index = 0;
+    voice->burst_left = 0;
+    voice->burst_comb = 0;
+    voice->burst_plain = 0;
+  }
+  instrument_model_seed(model, INSTRUMENT_SEED);
+
+  /* Enable the cycle counter so that the render cost can be measured */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  return INSTRUMENT_OK;
+}
+
+/* Give every voice its own generator for picking excitation bursts.
+   The same seed always produces the same sequence of bursts */
+InstrumentStatus instrument_model_seed(InstrumentModel *model, uint32_t seed) {
+  uint32_t i;
+
+  if ((model == NULL) || (seed == 0)) {
+    return INSTRUMENT_ERROR;
+  }
+
+  for (i = 0; i < MAX_VOICES; ++i) {
+    /* Spread the voices apart with the golden ratio and never leave
+       a generator stuck at zero */
+    model->voices[i].rand_state = seed + i * 0x9E3779B9U;
+    if (model->voices[i].rand_state == 0) {
+      model->voices[i].rand_state = seed;
+    }
+  }
+
+  return INSTRUMENT_OK;
+}
+
+/* Set where the strings of the next notes are plucked, as a Q15
+   fraction of the string length from 0 (the comb is off) to 16384
+   (the middle of the string) */
+InstrumentStatus instrument_model_pick(InstrumentModel *model, uint16_t position) {
+  if ((model == NULL) || (position > 16384U)) {
+    return INSTRUMENT_ERROR;
+  }
+
+  model->pick_position = position;
+
+  return INSTRUMENT_OK;
+}
+
+/* Get a sample of the burst that is being copied, i samples after the
+   next one to copy, as it ends up in the voice's memory */
+__STATIC_INLINE int16_t instrument_model_burst_sample(const InstrumentVoice *voice, uint32_t i) {
+  int32_t sample = voice->burst_p[i];
+
+  if (i >= voice->burst_plain) {
+    sample = (sample - (int32_t)voice->burst_p[(int32_t)i - (int32_t)voice->burst_comb]) >> 1;
+  }
+  return (int16_t)((sample * (int32_t)voice->burst_gain) >> 15);
+}
+
+/* Pick an excitation burst for the voice and make room for it in the
+   voice's memory. One of the variants is picked at random and the
+   velocity curve selects how loud and how bright the burst is. The
+   pick position sets the delay of the comb that the burst goes through,
+   as a Q15 fraction of the string. The burst itself is only copied
+   while the voice is rendered */
+__STATIC_INLINE void instrument_model_excite(InstrumentVoice *voice, uint8_t velocity, uint32_t delay,
+                                             uint16_t pick_position) {
+  uint32_t index_limit = voice->memory.mem_len - 1;
+  uint32_t variant;
+  uint32_t layer;
+  uint32_t i;
+
+  /* The taps of the new note start two samples before its burst, which
+     can be the end of a burst that was never fully copied */
+  for (i = (voice->burst_left > 2) ? (voice->burst_left - 2U) : 0; i < voice->burst_left; ++i) {
+    voice->memory.mem_p[(voice->burst_index + i) & index_limit] = instrument_model_burst_sample(voice, i);
+  }
+
+  variant = dsp_xorshift32(&voice->rand_state) & (EXCITATION_VARIANTS - 1);
+  layer = excitation_velocity_layers[velocity];
+
+  voice->burst_p = &excitation_bursts[variant][layer][0];
+  voice->burst_gain = excitation_velocity_gains[velocity];
+  voice->burst_index = voice->memory.rw_index;
+  voice->burst_left = delay;
+
+  /* The first K samples have nothing to be combed with yet */
+  voice->burst_comb = (uint16_t)((delay * pick_position + 16384U) >> 15);
+  voice->burst_plain = (voice->burst_comb > 0) ? voice->burst_comb : delay;
+
+  voice->memory.rw_index = (voice->memory.rw_index + delay) & index_limit;
+}
+
+/* Copy the part of the excitation burst that the taps are about to
+   reach, scaled to the level of the note. The taps read one new sample
+   per frame, so a burst is spread over the first D frames of the note */
+__STATIC_INLINE void instrument_model_feed(InstrumentVoice *voice, uint32_t frames) {
+  uint32_t index_limit = voice->memory.mem_len - 1;
+  int16_t *dst_p;
+  uint32_t plain;
+  uint32_t span;
+
+  if (frames > voice->burst_left) {
+    frames = voice->burst_left;
+  }
+  voice->burst_left -= frames;
+
+  /* Split the copy where the buffer wraps around */
+  while (frames > 0) {
+    span = voice->memory.mem_len - voice->burst_index;
+    if (span > frames) {
+      span = frames;
+    }
+
+    plain = (span < voice->burst_plain) ? span : voice->burst_plain;
+    voice->burst_plain -= plain;
+
+    dst_p = &voice->memory.mem_p[voice->burst_index];
+    dsp_scale_run(dst_p, voice->burst_p, plain, voice->burst_gain);
+    if (span > plain) {
+      dsp_comb_run(dst_p + plain, voice->burst_p + plain, voice->burst_p + plain - voice->burst_comb,
+                   span - plain, voice->burst_gain);
+    }
+    voice->burst_p += span;
+    voice->burst_index = (voice->burst_index + span) & index_limit;
+    frames -= span;
+  }
+}
+
+/* Move a voice to another position of the pitch wheel. The loop delay
+   D * 16384 + c of the voice's note is interpolated between the two
+   entries of its bend table around the position, which were solved by
+   Tools/gen_tables.c. This runs once per rendered span of a voice whose
+   bend is out of date, never per sample */
+static void instrument_model_retune(InstrumentVoice *voice, uint16_t position) {
+  const uint32_t *entry_p = &voice->bend_delays[position >> 7];
+  uint32_t delay;
+  uint32_t lag;
+
+  /* The table gets shorter towards the top end */
+  delay = entry_p[0] - (((entry_p[0] - entry_p[1]) * (position & 0x7FU)) >> 7);
+  voice->max_delay = (uint16_t)(delay >> 14);
+  voice->frac_coeff = (uint16_t)(delay & 0x3FFFU);
+
+  /* A shorter delay moves the newest tap onto samples of the burst
+     that have not been copied yet. Only those are copied now, the rest
+     of the burst is still copied as the taps reach it */
+  lag = (voice->memory.rw_index - voice->burst_index) & (voice->memory.mem_len - 1);
+  if ((voice->burst_left > 0) && (lag > voice->max_delay)) {
+    instrument_model_feed(voice, lag - voice->max_delay);
+  }
+
+  voice->bend = position;
+  voice->coeffs = dsp_ks_coeffs(voice->frac_coeff, voice->stretch_coeff,
+                                voice->released ? voice->release_coeff : voice->loss_coeff);
+}
+
+/* Use the LPF for the Karplus-Strong algorithm on a number of frames
+   and add the results to the mono mix. The circular memory buffer is
+   split into contiguous spans between the points where either the
+   read/write index or the taps wrap around */
+static void instrument_model_render(InstrumentVoice *voice, int16_t *mix_p, uint32_t frames,
+                                    uint16_t bend) {
+  int16_t *mem_p = voice->memory.mem_p;
+  uint32_t mem_len = voice->memory.mem_len;
+  uint32_t index_limit = mem_len - 1;
+  uint32_t rw_index = voice->memory.rw_index;
+  uint32_t chunk_len;
+  uint32_t tap_index;
+  uint32_t span;
+  int16_t taps[3];
+  int32_t level;
+  uint32_t i;
+
+  if (voice->bend != bend) {
+    instrument_model_retune(voice, bend);
+  }
+
+  /* Taps trail the writes by D+2 samples and lead them by mem_len-D-2
+     samples once they wrap around. Chunks that fit in both distances
+     can be computed in parallel */
+  chunk_len = voice->max_delay;
+  if (chunk_len > (mem_len - voice->max_delay - 2)) {
+    chunk_len = mem_len - voice->max_delay - 2;
+  }
+
+  if (voice->burst_left > 0) {
+    instrument_model_feed(voice, frames);
+  }
+
+  level = voice->released ? RELEASE_THRESHOLD : SILENCE_THRESHOLD;
+
+  while (frames > 0) {
+    /* Taps start at y[n-D-2] */
+    tap_index = (rw_index - voice->max_delay - 2) & index_limit;
+
+    span = mem_len - rw_index;
+    if (span > frames) {
+      span = frames;
+    }
+    if (tap_index >= (index_limit - 1)) {
+      span = 0;
+    } else if (span > (index_limit - 1 - tap_index)) {
+      span = index_limit - 1 - tap_index;
+    }
+
+    if (span == 0) {
+      /* The taps straddle the end of the memory buffer */
+      for (i = 0; i < 3; ++i) {
+        taps[i] = mem_p[(tap_index + i) & index_limit];
+      }
+      mem_p[rw_index] = dsp_ks_frac(taps, voice->coeffs);
+      span = 1;
+    } else {
+      dsp_ks_run(&mem_p[rw_index], &mem_p[tap_index], span, chunk_len, voice->coeffs);
+    }
+
+    dsp_mix_run(mix_p, &mem_p[rw_index], span);
+    mix_p += span;
+
+    /* Count the frames since the voice was last heard so that it can
+       be freed once it has died out. A loud span restarts the count,
+       and the scan stops at its first loud sample. Counting stops once
+       the count is past any loop delay and period */
+    if (dsp_level_run(&mem_p[rw_index], span, level)) {
+      voice->quiet_frames = 0;
+    } else if (voice->quiet_frames < DELAY_LINE_SIZE) {
+      voice->quiet_frames += span;
+    }
+
+    rw_index = (rw_index + span) & index_limit;
+    frames -= span;
+  }
+
+  voice->memory.rw_index = rw_index;
+}
+
+/* Check if a buffer section is waiting to be processed */
+uint8_t instrument_model_pending(InstrumentModel *model) {
+  return (model != NULL) && (model->section_done != section_ready);
+}
 
-  /* Initialize values for model's memory (circular) buffer */
-  model->memory.mem_p = &mem_buffer[0];
-  model->memory.mem_len = sizeof(mem_buffer) / sizeof(int16_t);
-  model->memory.rw_index = 0;
+/* Start processing the buffer section that is waiting, if any. The
+   section can then be rendered in parts so that the voices can be
+   changed at any frame inside it */
+InstrumentStatus instrument_model_begin(InstrumentModel *model) {
+  BufferSection section_ready_cpy = section_ready;
+
+  if (model == NULL) {
+    return INSTRUMENT_ERROR;
+  }
+
+  if ((model->section_busy != BUFFER_SECTION_NONE) ||
+      (model->section_done == section_ready_cpy)) {
+    return INSTRUMENT_OK;
+  }
+
+  model->start_cycles = DWT->CYCCNT;
+
+  if (section_ready_cpy == BUFFER_SECTION_FIRST_HALF) {
+    /* Start at the beginning of the first buffer section */
+    model->section_p = model->audio_p;
+  } else {
+    /* Start at the beginning of the second buffer section */
+    model->section_p = model->audio_p + (AUDIO_CHANNELS * AUDIO_PERIOD_SIZE);
+  }
+
+  /* Voices are mixed in mono and only copied to both channels once
+     all of them have been rendered */
+#if (AUDIO_CHANNELS == 2)
+  model->mix_p = &mix_buffer[0];
+#else
+  model->mix_p = model->section_p;
+#endif
+
+  /* The mix is only cleared once a voice is rendered into it */
+  model->block_silent = 1;
+  model->block_offset = 0;
+  model->section_busy = section_ready_cpy;
 
   return INSTRUMENT_OK;
 }
 
-/* Generate an excitation signal for the instrument and store it
-   in the instrument's memory */
-__STATIC_INLINE void instrument_model_excite(InstrumentModel *model, uint32_t delay) {
-  uint32_t index_limit = model->memory.mem_len - 1;
-  float rand_num = 0.0f;
+/* Render every active voice from where the last part of the buffer
+   section ended up to the given frame offset */
+InstrumentStatus instrument_model_render_to(InstrumentModel *model, uint32_t offset) {
+  InstrumentVoice *voice;
+  uint32_t i;
 
-  while (delay--) {
-    rand_num = 2.0f * MAX_AMPLITUDE * ((float)rand() / (float)(RAND_MAX)) - 1.0f;
+  if ((model == NULL) || (offset > AUDIO_PERIOD_SIZE)) {
+    return INSTRUMENT_ERROR;
+  }
 
-    /* Start from the last read/write position and watch for 
-       when the buffer wraps around */
-    model->memory.mem_p[model->memory.rw_index] = rand_num;
-    model->memory.rw_index = (model->memory.rw_index + 1) & index_limit;
+  if ((model->section_busy == BUFFER_SECTION_NONE) || (offset <= model->block_offset)) {
+    return INSTRUMENT_OK;
   }
+
+  for (i = 0; i < MAX_VOICES; ++i) {
+    voice = &model->voices[i];
+    if (!voice->active) {
+      continue;
+    }
+
+    if (model->block_silent) {
+      memset(model->mix_p, 0, AUDIO_PERIOD_SIZE * sizeof(int16_t));
+      model->block_silent = 0;
+    }
+
+    /* Apply the filter and mix the voice into the buffer section */
+    instrument_model_render(voice, model->mix_p + model->block_offset,
+                            offset - model->block_offset, model->bend);
+  }
+
+  model->block_offset = offset;
+
+  return INSTRUMENT_OK;
 }
 
-/* Use the LPF for the Karplus-Strong algorithm and store the result into
-   the current position in the audio buffer */
-__STATIC_INLINE void instrument_model_filter(InstrumentModel *model, int16_t *pbuffer) {
-  int16_t *mem_p = model->memory.mem_p;
-  uint32_t index_limit = model->memory.mem_len - 1;
-  uint32_t delay_index;
-  float past_val1;
-  float past_val2;
-  int16_t result;
+/* Render the rest of the buffer section and hand it over to the DMA */
+InstrumentStatus instrument_model_end(InstrumentModel *model) {
+  InstrumentVoice *voice;
+  uint32_t voice_count = 0;
+  uint32_t load = 0;
+  uint32_t quiet_limit;
+  uint8_t section_bit;
+  uint32_t i;
+
+  if (model == NULL) {
+    return INSTRUMENT_ERROR;
+  }
+
+  if (model->section_busy == BUFFER_SECTION_NONE) {
+    return INSTRUMENT_OK;
+  }
 
-  /* y[n] = 0.5 * ( y[n-D] + y[n-D-1] ) */
-  delay_index = model->memory.rw_index - model->max_delay;
-  past_val1 = (float)mem_p[delay_index & index_limit];
-  past_val2 = (float)mem_p[(delay_index-1) & index_limit];
-  result = (int16_t)(0.5f * (past_val1 + past_val2));
+  instrument_model_render_to(model, AUDIO_PERIOD_SIZE);
 
-  *pbuffer = result;
+  section_bit = (model->section_busy == BUFFER_SECTION_FIRST_HALF) ? 0x1U : 0x2U;
+  if (!model->block_silent) {
 #if (AUDIO_CHANNELS == 2)
-  *(pbuffer + 1) = result;
+    dsp_stereo_expand(model->section_p, model->mix_p, AUDIO_PERIOD_SIZE);
 #endif
+    model->silent_sections &= ~section_bit;
+  } else if (!(model->silent_sections & section_bit)) {
+    /* No voice was rendered, so the section only has to be cleared if
+       it still holds older audio */
+    memset(model->section_p, 0, AUDIO_CHANNELS * AUDIO_PERIOD_SIZE * sizeof(int16_t));
+    model->silent_sections |= section_bit;
+  }
+
+  for (i = 0; i < MAX_VOICES; ++i) {
+    voice = &model->voices[i];
+    voice_count += voice->active;
+    if (voice->active) {
+      load += voice->burst_gain;
+    }
+
+    /* Voices that have died out are not rendered anymore. They are
+       counted for as long as they stay idle */
+    quiet_limit = voice->max_delay + 2U;
+    if (quiet_limit < AUDIO_PERIOD_SIZE) {
+      quiet_limit = AUDIO_PERIOD_SIZE;
+    }
+    if (voice->active && (voice->quiet_frames >= quiet_limit)) {
+      voice->active = 0;
+      voice->idle = 1;
+      model->sustained_voices &= ~(1UL << i);
+    }
+    if (voice->idle) {
+      ++model->skipped_voice_blocks;
+    }
+  }
 
-  /* Store result in the memory and update the read/write index */
-  mem_p[model->memory.rw_index] = result;
-  model->memory.rw_index = (model->memory.rw_index + 1) & index_limit;
+  model->block_cycles = DWT->CYCCNT - model->start_cycles;
+  model->block_voices = voice_count;
+  model->mix_load = load;
+  model->section_done = model->section_busy;
+  model->section_busy = BUFFER_SECTION_NONE;
+
+  return INSTRUMENT_OK;
 }
 
-/* Check if the current buffer section needs to be processed */
+/* Check if the current buffer section needs to be processed. Exactly
+   one period is rendered per call */
 InstrumentStatus instrument_model_process(InstrumentModel *model) {
-  BufferSection section_ready_cpy = section_ready;
-  int16_t *buffer_p = NULL;
-  uint32_t loop_count = 0;
+  if (instrument_model_begin(model) != INSTRUMENT_OK) {
+    return INSTRUMENT_ERROR;
+  }
 
-  if (model == NULL) {
+  return instrument_model_end(model);
+}
+
+/* Start a note on a free voice, or steal the oldest voice if all of
+   them are in use. A note that is already sounding gets re-plucked */
+InstrumentStatus instrument_model_note_on(InstrumentModel *model, uint8_t note, uint8_t velocity,
+                                         uint16_t delay, uint16_t frac_coeff, uint16_t stretch_coeff,
+                                         uint16_t loss_coeff, const uint32_t *bend_delays) {
+  InstrumentVoice *voice = NULL;
+  uint32_t start_cycles = DWT->CYCCNT;
+  uint32_t index = 0;
+  uint32_t i;
+
+  /* The delay line must keep at least three samples more than the
+     longest delay, and the pair kernel needs a delay of at least two so
+     that the two samples it writes do not depend on each other. The
+     fractional delay and the loop gain must both stay below one and the
+     stretch factor may not exceed one half. The same limits hold for
+     the delay bent all the way down and up */
+  if ((model == NULL) || (velocity > 127U) || (delay < 2U) || (delay > (DELAY_LINE_SIZE - 4)) ||
+      (frac_coeff >= 16384U) || (stretch_coeff > 16384U) || (loss_coeff >= 32768U) ||
+      (bend_delays == NULL) || ((bend_delays[0] >> 14) > (DELAY_LINE_SIZE - 4)) ||
+      ((bend_delays[BEND_STEPS] >> 14) < 2U)) {
     return INSTRUMENT_ERROR;
   }
 
-  if (model->section_done != section_ready_cpy) {
-    loop_count = AUDIO_BUFFER_SIZE / 2;
+  for (i = 0; i < MAX_VOICES; ++i) {
+    if (model->voices[i].active && (model->voices[i].note == note)) {
+      voice = &model->voices[i];
+      break;
+    }
+  }
 
-    if (section_ready_cpy == BUFFER_SECTION_FIRST_HALF) {
-      /* Start at the beginning of the first buffer section */
-      buffer_p = model->audio_p;
-    } else {
-      /* Start at the beginning of the second buffer section */
-      buffer_p = model->audio_p + (AUDIO_CHANNELS * AUDIO_BUFFER_SIZE / 2);
+  if (voice == NULL) {
+    /* Search for a free voice starting from the oldest one and fall
+       back to stealing the oldest voice */
+    index = model->next_voice;
+    for (i = 0; i < MAX_VOICES; ++i) {
+      if (!model->voices[(model->next_voice + i) % MAX_VOICES].active) {
+        index = (model->next_voice + i) % MAX_VOICES;
+        break;
+      }
     }
+    voice = &model->voices[index];
+    model->next_voice = (index + 1) % MAX_VOICES;
+  }
+  index = (uint32_t)(voice - &model->voices[0]);
+
+  /* A new key press takes the voice back from the pedal */
+  model->sustained_voices &= ~(1UL << index);
+
+  voice->note = note;
+  voice->idle = 0;
+  voice->released = 0;
+  voice->quiet_frames = 0;
+  voice->max_delay = delay;
+  voice->frac_coeff = frac_coeff;
+  voice->stretch_coeff = stretch_coeff;
+  voice->loss_coeff = loss_coeff;
+  voice->bend = BEND_CENTER;
+  voice->bend_delays = bend_delays;
+  voice->coeffs = dsp_ks_coeffs(frac_coeff, stretch_coeff, loss_coeff);
+
+  /* Queue the excitation signal for the voice's memory buffer */
+  instrument_model_excite(voice, velocity, delay, model->pick_position);
+  voice->active = 1;
+
+  model->note_on_cycles = DWT->CYCCNT - start_cycles;
+
+  return INSTRUMENT_OK;
+}
+
+/* Switch a voice to its release damping */
+__STATIC_INLINE void instrument_model_release(InstrumentVoice *voice) {
+  voice->coeffs = dsp_ks_coeffs(voice->frac_coeff, voice->stretch_coeff, voice->release_coeff);
+  voice->released = 1;
+}
 
-    while (loop_count--) {
-      /* Apply the filter to the current buffer section */
-      instrument_model_filter(model, buffer_p);
-      buffer_p += AUDIO_CHANNELS;
+/* Damp the voice that is playing a note once its key is released, or
+   leave it ringing until the sustain pedal is lifted. The voice is
+   freed later, when it has died out */
+InstrumentStatus instrument_model_note_off(InstrumentModel *model, uint8_t note, uint16_t release_coeff) {
+  InstrumentVoice *voice;
+  uint32_t i;
+
+  if ((model == NULL) || (release_coeff >= 32768U)) {
+    return INSTRUMENT_ERROR;
+  }
+
+  /* The voice may already have been stolen by another note */
+  for (i = 0; i < MAX_VOICES; ++i) {
+    voice = &model->voices[i];
+    if (voice->active && !voice->released && (voice->note == note)) {
+      voice->release_coeff = release_coeff;
+      if (model->sustain) {
+        model->sustained_voices |= 1UL << i;
+      } else {
+        instrument_model_release(voice);
+      }
+      break;
     }
-    model->section_done = section_ready_cpy;
   }
 
   return INSTRUMENT_OK;
 }
 
-/* Update the instrument model's properties */
-InstrumentStatus instrument_model_change(InstrumentModel *model, uint16_t delay) {
+/* Press or lift the sustain pedal. Lifting it damps every voice whose
+   key was released while the pedal was down. Only the voices in the
+   mask are visited */
+InstrumentStatus instrument_model_sustain(InstrumentModel *model, uint8_t pedal_down) {
+  uint32_t held;
+  uint32_t i;
+
   if (model == NULL) {
     return INSTRUMENT_ERROR;
   }
 
-  model->max_delay = delay;
-  model->section_done = BUFFER_SECTION_NONE;
+  model->sustain = (pedal_down != 0);
+  if (model->sustain) {
+    return INSTRUMENT_OK;
+  }
+
+  held = model->sustained_voices;
+  for (i = 0; held != 0; ++i, held >>= 1) {
+    if (held & 1U) {
+      instrument_model_release(&model->voices[i]);
+    }
+  }
+  model->sustained_voices = 0;
 
-  /* Store the excitation signal into the memory buffer */
-  instrument_model_excite(model, delay);
+  return INSTRUMENT_OK;
+}
+
+/* Bend the pitch of every voice, including the notes that start
+   later. The position is the 14-bit value of the pitch wheel, with the
+   pitch left alone at the center. The voices pick it up the next time
+   they are rendered */
+InstrumentStatus instrument_model_bend(InstrumentModel *model, uint16_t position) {
+  if ((model == NULL) || (position > BEND_MAX)) {
+    return INSTRUMENT_ERROR;
+  }
+
+  model->bend = position;
 
   return INSTRUMENT_OK;
 }
+
+/* Get the average number of cycles spent per voice during the
+   last processed buffer section */
+uint32_t instrument_model_voice_cycles(InstrumentModel *model) {
+  if ((model == NULL) || (model->block_voices == 0)) {
+    return 0;
+  }
+
+  return model->block_cycles / model->block_voices;
+}
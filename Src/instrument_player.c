@@ -18,71 +18,298 @@
 #include "instrument_player.h"
 #include "delay_lengths.h"
 
+#if (NOTE_MAX_DELAY > (DELAY_LINE_SIZE - 4))
+#error "Longest delay does not fit in the instrument's memory buffer"
+#endif
 
-uint8_t midi_rx_buffer[RX_BUFFER_SIZE];
+#if (NOTE_MAX_BENT_DELAY > (DELAY_LINE_SIZE - 4))
+#error "Longest delay bent down by the pitch wheel does not fit in the instrument's memory buffer"
+#endif
+
+
+static uint8_t midi_rx_buffers[RX_BUFFERS][RX_BUFFER_SIZE];
+static uint8_t rx_buffer = 0;
 static InstrumentModel instrument;
+static MidiQueue midi_queue;
+static MidiDecoder midi_decoder;
+static MidiOutQueue midi_out_queue;
+static uint8_t midi_tx_buffer[MIDI_OUT_PACKET_SIZE];
+static uint16_t tx_length = 0;
+static uint8_t tx_busy = 0;
+static USBH_HandleTypeDef *midi_host = NULL;
+static volatile uint32_t late_periods = 0;
+static volatile uint32_t periods_played = 0;
 
 
 /* Initialize instrument model and audio peripheral */
 void instrument_player_init(void) {
   uint32_t buffer_size;
 
-  if (instrument_model_init(&instrument, 0) != INSTRUMENT_OK) {
+  if (instrument_model_init(&instrument) != INSTRUMENT_OK) {
     error_handler();
   }
-  if (BSP_AUDIO_OUT_Init(OUTPUT_DEVICE_HEADPHONE, AUDIO_VOLUME, SAMPLE_FREQUENCY) != AUDIO_OK) {
+  midi_queue_init(&midi_queue);
+  midi_out_queue_init(&midi_out_queue);
+  midi_decoder_init(&midi_decoder, MIDI_CABLE, MIDI_CHANNEL_MASK,
+                    MIDI_TYPE_BIT(NOTE_OFF) | MIDI_TYPE_BIT(NOTE_ON) |
+                    MIDI_TYPE_BIT(CONTROL_CHANGE) | MIDI_TYPE_BIT(PITCH_BEND));
+  if (audio_out_init(OUTPUT_DEVICE_HEADPHONE, AUDIO_VOLUME, SAMPLE_FREQUENCY) != AUDIO_OK) {
     error_handler();
   }
 
-  /* Start playing from instrument's audio buffer */
+  /* Start playing from instrument's audio buffer. The DMA loops over
+     the buffer until the player is stopped */
   buffer_size = instrument.buffer_len * sizeof(int16_t);
-  if (BSP_AUDIO_OUT_Play((uint16_t*)instrument.audio_p, buffer_size) != AUDIO_OK) {
+  if (audio_out_play(instrument.audio_p, buffer_size) != AUDIO_OK) {
     error_handler();
   }
 }
 
+/* Send as many waiting packets as fit in one bulk transfer, unless the
+   previous one is still in flight. A packed transfer that the driver
+   did not take is kept and tried again on the next call */
+static void instrument_player_flush_midi(void) {
+  if ((midi_host == NULL) || tx_busy) {
+    return;
+  }
+
+  if (tx_length == 0) {
+    tx_length = midi_out_queue_pack(&midi_out_queue, &midi_tx_buffer[0], MIDI_OUT_PACKET_SIZE);
+  }
+  if ((tx_length > 0) && (usbh_midi_transmit(midi_host, &midi_tx_buffer[0], tx_length) == USBH_OK)) {
+    tx_busy = 1;
+    tx_length = 0;
+  }
+}
+
+/* Start receiving from a MIDI device once it is connected */
+void instrument_player_start_midi(USBH_HandleTypeDef *phost) {
+  midi_host = phost;
+  tx_busy = 0;
+  rx_buffer = 0;
+  usbh_midi_receive(phost, &midi_rx_buffers[0][0], RX_BUFFER_SIZE);
+  instrument_player_flush_midi();
+}
+
+/* Forget the device once it is disconnected, along with the packets
+   that were waiting for it and the transfer that never completed */
+void instrument_player_stop_midi(void) {
+  midi_host = NULL;
+  tx_busy = 0;
+  tx_length = 0;
+  midi_out_queue_clear(&midi_out_queue);
+}
+
+/* Queue a USB-MIDI packet for the device, e.g. MIDI thru, feedback
+   for the lights of the keyboard or telemetry. Packets are sent many
+   at a time as soon as the OUT pipe is free */
+MidiQueueStatus instrument_player_send(const MIDI_Packet *packet) {
+  MidiQueueStatus status;
+
+  status = midi_out_queue_push(&midi_out_queue, packet);
+  instrument_player_flush_midi();
+
+  return status;
+}
+
+/* Apply a MIDI event to the instrument model */
+static void instrument_player_apply(const MidiEvent *event) {
+  uint16_t note_index;
+
+  if (event->type == CONTROL_CHANGE) {
+    if ((event->data1 == MIDI_CC_PICK_POSITION) &&
+        (instrument_model_pick(&instrument, (uint16_t)event->data2 << 7) != INSTRUMENT_OK)) {
+      error_handler();
+    } else if ((event->data1 == MIDI_CC_SUSTAIN) &&
+               (instrument_model_sustain(&instrument, event->data2 >= 64U) != INSTRUMENT_OK)) {
+      error_handler();
+    }
+    return;
+  }
+
+  if (event->type == PITCH_BEND) {
+    if (instrument_model_bend(&instrument, ((uint16_t)event->data2 << 7) | event->data1) != INSTRUMENT_OK) {
+      error_handler();
+    }
+    return;
+  }
+
+  /* Ignore the keys that are outside of the note tables */
+  if ((event->data1 > MIDI_NOTE_OFFSET) ||
+      ((MIDI_NOTE_OFFSET - event->data1) >= NUM_OF_NOTES)) {
+    return;
+  }
+  note_index = MIDI_NOTE_OFFSET - event->data1;
+
+  if (event->type == NOTE_ON) {
+    if (instrument_model_note_on(&instrument, event->data1, event->data2,
+                                 note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                                 note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                                 note_bend_delays[note_index]) != INSTRUMENT_OK) {
+      error_handler();
+    }
+  } else if (event->type == NOTE_OFF) {
+    if (instrument_model_note_off(&instrument, event->data1,
+                                  note_release_coeffs[note_index]) != INSTRUMENT_OK) {
+      error_handler();
+    }
+  }
+}
+
+/* Get the number of frames the DMA has read since playback started */
+static uint32_t instrument_player_frame_position(void) {
+  uint32_t section_len = AUDIO_CHANNELS * AUDIO_PERIOD_SIZE;
+  BufferSection reading;
+  uint32_t periods;
+  uint32_t read;
+
+  /* Read again if a period ends while the DMA position is read */
+  do {
+    periods = periods_played;
+    reading = (section_ready == BUFFER_SECTION_FIRST_HALF) ? BUFFER_SECTION_SECOND_HALF
+                                                           : BUFFER_SECTION_FIRST_HALF;
+    read = instrument.buffer_len - audio_out_remaining();
+  } while (periods != periods_played);
+
+  /* The DMA can move into the next half before the half or full
+     transfer interrupt has counted the period that ended */
+  if ((read >= section_len) != (reading == BUFFER_SECTION_SECOND_HALF)) {
+    ++periods;
+  }
+
+  return periods * AUDIO_PERIOD_SIZE + (read % section_len) / AUDIO_CHANNELS;
+}
+
 /* Play the instrument :) */
 void instrument_player_play(void) {
-  if (instrument_model_process(&instrument) != INSTRUMENT_OK) {
+  MidiEvent event;
+  uint32_t block_frame;
+  int32_t offset;
+
+  if (!instrument_model_pending(&instrument)) {
+    return;
+  }
+
+  /* The free section is played once the DMA is done with the
+     section it is reading now */
+  block_frame = (periods_played + 1) * AUDIO_PERIOD_SIZE;
+
+  if (instrument_model_begin(&instrument) != INSTRUMENT_OK) {
     error_handler();
   }
+
+  /* Every event is played a whole buffer after it was received so
+     that it starts on the same frame it arrived at. Events that are
+     already late start at the beginning of the section and events
+     for a later section stay in the queue */
+  while (midi_queue_peek(&midi_queue, &event) == MIDI_QUEUE_OK) {
+    offset = (int32_t)(event.timestamp + AUDIO_BUFFER_SIZE - block_frame);
+    if (offset >= (int32_t)AUDIO_PERIOD_SIZE) {
+      break;
+    }
+    if ((offset > 0) && (instrument_model_render_to(&instrument, offset) != INSTRUMENT_OK)) {
+      error_handler();
+    }
+
+    instrument_player_apply(&event);
+    midi_queue_pop(&midi_queue, &event);
+  }
+
+  if (instrument_model_end(&instrument) != INSTRUMENT_OK) {
+    error_handler();
+  }
+
+  /* Retry a transfer the driver was not ready for */
+  instrument_player_flush_midi();
+}
+
+/* Get the number of MIDI events lost because the queue was full */
+uint32_t instrument_player_dropped_events(void) {
+  return midi_queue.dropped;
+}
+
+/* Get the number of USB-MIDI packets that were not for the instrument,
+   including the real-time messages */
+uint32_t instrument_player_filtered_packets(void) {
+  return midi_decoder.filtered + midi_decoder.realtime + midi_decoder.invalid;
+}
+
+/* Get the number of USB-MIDI packets waiting to be sent */
+uint32_t instrument_player_queued_out_packets(void) {
+  return midi_out_queue_depth(&midi_out_queue);
+}
+
+/* Get the number of USB-MIDI packets that could not be sent because
+   the queue was full or the device went away */
+uint32_t instrument_player_dropped_out_packets(void) {
+  return midi_out_queue.dropped;
+}
+
+/* Get the number of periods that were not rendered before the DMA
+   started reading them */
+uint32_t instrument_player_late_periods(void) {
+  return late_periods;
+}
+
+/* Hand the half the DMA has just left to the renderer. The DMA goes
+   on with the half that was handed over last time, which is late if
+   it was not rendered since */
+static void instrument_player_period_done(BufferSection section_free) {
+  if (instrument.section_done != section_ready) {
+    ++late_periods;
+    /* The last half that was rendered is the one that is free now, so
+       it would be taken as done and skipped as well */
+    instrument.section_done = BUFFER_SECTION_NONE;
+  }
+  ++periods_played;
+  section_ready = section_free;
 }
 
 /* DMA has finished reading first half of audio buffer */
 void BSP_AUDIO_OUT_HalfTransfer_CallBack(void) {
-  section_ready = BUFFER_SECTION_FIRST_HALF;
+  instrument_player_period_done(BUFFER_SECTION_FIRST_HALF);
 }
 
-/* DMA has finished reading second half of audio buffer */
+/* DMA has finished reading second half of audio buffer and
+   wrapped around to the first half on its own */
 void BSP_AUDIO_OUT_TransferComplete_CallBack(void) {
-  /* Must divide buffer size by 2 because of the way the ChangeBuffer 
-     function works */
-  uint16_t buffer_size = instrument.buffer_len * sizeof(int16_t) / 2;
-
-  BSP_AUDIO_OUT_ChangeBuffer((uint16_t*)instrument.audio_p, buffer_size);
-  section_ready = BUFFER_SECTION_SECOND_HALF;
+  instrument_player_period_done(BUFFER_SECTION_SECOND_HALF);
 }
 
-/* Process MIDI packets and change the note according to key pressed
-   on digital piano */
+/* Decode MIDI packets and queue the keys pressed and released and the
+   controllers and the pitch wheel moved on the digital piano for the
+   renderer */
 void usbh_midi_rx_callback(USBH_HandleTypeDef *phost) {
-  MIDI_Packet *packet_p = (MIDI_Packet*)&midi_rx_buffer[0];
+  MIDI_Packet *packet_p = (MIDI_Packet*)&midi_rx_buffers[rx_buffer][0];
   uint16_t num_of_packets;
-  uint16_t note_delay;
+  MidiEvent event;
+  uint32_t frame;
 
   num_of_packets = usbh_midi_last_rx_size(phost) / 4;
-  while (num_of_packets--) {
-    /* Check if MIDI message is a Note-On event */
-    if (GET_CIN(packet_p->header) == NOTE_ON) {
-      note_delay = note_delay_lengths[MIDI_NOTE_OFFSET - packet_p->byte2];
+  frame = instrument_player_frame_position();
+
+  /* Queue the next transfer into the other buffer before this batch
+     is decoded, so that the IN pipe keeps being polled meanwhile */
+  rx_buffer = (rx_buffer + 1) % RX_BUFFERS;
+  usbh_midi_receive(phost, &midi_rx_buffers[rx_buffer][0], RX_BUFFER_SIZE);
 
-      if (instrument_model_change(&instrument, note_delay) != INSTRUMENT_OK) {
-        error_handler();
-      }
+  while (num_of_packets--) {
+    /* A full queue is counted by the queue itself */
+    if (midi_decoder_decode(&midi_decoder, packet_p, &event)) {
+      event.timestamp = frame;
+      midi_queue_push(&midi_queue, &event);
+#if (MIDI_THRU == 1)
+      instrument_player_send(packet_p);
+#endif
     }
 
     ++packet_p;
   }
-  /* Refill MIDI RX buffer */
-  usbh_midi_receive(phost, &midi_rx_buffer[0], RX_BUFFER_SIZE);
-}
\ No newline at end of file
+}
+
+/* The previous transfer has been sent, start the next one */
+void usbh_midi_tx_callback(USBH_HandleTypeDef *phost) {
+  midi_out_queue_complete(&midi_out_queue);
+  tx_busy = 0;
+  instrument_player_flush_midi();
+}
@@ -35,9 +35,6 @@ int main(void) {
   BSP_LED_Init(LED3);
   BSP_LED_Init(LED4);
 
-  /* Make excitation signals deterministic */
-  srand(8675309);
-
   /* Initialize and start USB host */
   USBH_Init(&usb_host, usbh_user_process, 0);
   USBH_RegisterClass(&usb_host, USBH_MIDI_CLASS);
@@ -58,12 +55,13 @@ static void usbh_user_process(USBH_HandleTypeDef *phost, uint8_t event_id) {
   switch (event_id) {
     case HOST_USER_DISCONNECTION:
       usbh_midi_stop(phost);
+      instrument_player_stop_midi();
       BSP_LED_Off(LED4);
       break;
 
     case HOST_USER_CLASS_ACTIVE:
-      /* Fill MIDI message buffer once at the start */
-      usbh_midi_receive(phost, &midi_rx_buffer[0], RX_BUFFER_SIZE);
+      /* Start filling the MIDI message buffers */
+      instrument_player_start_midi(phost);
       BSP_LED_On(LED4);
       break;
 
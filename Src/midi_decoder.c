@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "midi_decoder.h"
+
+/* What a code index number carries */
+#define CIN_CHANNEL   0x1U  /* channel message, status nibble matches the CIN */
+#define CIN_SYSTEM    0x2U  /* system common or system exclusive bytes */
+#define CIN_REALTIME  0x4U  /* may hold a single real-time byte */
+
+/* Properties of every code index number of USB-MIDI 1.0: the number of
+   MIDI bytes in the packet and the kind of message */
+typedef struct {
+  uint8_t size;
+  uint8_t flags;
+} MidiCinInfo;
+
+static const MidiCinInfo cin_table[16] = {
+  [MISCELLANEOUS]          = {0, 0},
+  [CABLE_EVENTS]           = {0, 0},
+  [TWO_BYTE_MSG]           = {2, CIN_SYSTEM},
+  [THREE_BYTE_MSG]         = {3, CIN_SYSTEM},
+  [SYS_EX_START]           = {3, CIN_SYSTEM},
+  [SYS_EX_END_ONE_BYTE]    = {1, CIN_SYSTEM},
+  [SYS_EX_END_TWO_BYTES]   = {2, CIN_SYSTEM},
+  [SYS_EX_END_THREE_BYTES] = {3, CIN_SYSTEM},
+  [NOTE_OFF]               = {3, CIN_CHANNEL},
+  [NOTE_ON]                = {3, CIN_CHANNEL},
+  [POLY_KEY_PRESS]         = {3, CIN_CHANNEL},
+  [CONTROL_CHANGE]         = {3, CIN_CHANNEL},
+  [PROGRAM_CHANGE]         = {2, CIN_CHANNEL},
+  [CHANNEL_PRESSURE]       = {2, CIN_CHANNEL},
+  [PITCH_BEND]             = {3, CIN_CHANNEL},
+  [SINGLE_BYTE_MSG]        = {1, CIN_REALTIME}
+};
+
+
+/* Set up which cable, channels (bit n for channel n) and types (bit n
+   for code index number n) are let through and clear the counters */
+void midi_decoder_init(MidiDecoder *decoder, uint8_t cable, uint16_t channel_mask, uint16_t type_mask) {
+  decoder->cable = cable;
+  decoder->channel_mask = channel_mask;
+  decoder->type_mask = type_mask;
+  decoder->decoded = 0;
+  decoder->filtered = 0;
+  decoder->realtime = 0;
+  decoder->invalid = 0;
+}
+
+/* Decode a single packet. Returns 1 and fills in everything but the
+   timestamp of the event when the packet holds a wanted channel
+   message, otherwise 0. A Note-On with a velocity of zero is turned
+   into the Note-Off it stands for */
+uint8_t midi_decoder_decode(MidiDecoder *decoder, const MIDI_Packet *packet, MidiEvent *event) {
+  uint8_t cin = GET_CIN(packet->header);
+  const MidiCinInfo *info = &cin_table[cin];
+
+  /* Real-time bytes are dropped before anything else since they make
+     up most of the traffic of a keyboard that sends a clock */
+  if ((info->flags & CIN_REALTIME) && (packet->byte1 >= 0xF8U)) {
+    ++decoder->realtime;
+    return 0;
+  }
+
+  if ((GET_CN(packet->header) != decoder->cable) || !(info->flags & CIN_CHANNEL) ||
+      !(decoder->type_mask & MIDI_TYPE_BIT(cin)) ||
+      !(decoder->channel_mask & (1U << (packet->byte1 & 0xFU)))) {
+    ++decoder->filtered;
+    return 0;
+  }
+
+  /* The status byte has to agree with the code index number */
+  if ((packet->byte1 >> 4) != cin) {
+    ++decoder->invalid;
+    return 0;
+  }
+
+  event->type = cin;
+  event->channel = packet->byte1 & 0xFU;
+  event->data1 = packet->byte2 & 0x7FU;
+  event->data2 = (info->size == 3) ? (packet->byte3 & 0x7FU) : 0;
+  if ((cin == NOTE_ON) && (event->data2 == 0)) {
+    event->type = NOTE_OFF;
+  }
+
+  ++decoder->decoded;
+  return 1;
+}
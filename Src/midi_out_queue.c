@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "midi_out_queue.h"
+
+/* Status byte of a channel voice message, any channel */
+#define IS_CHANNEL_STATUS(STATUS)  (((STATUS) >= 0x80U) && ((STATUS) < 0xF0U))
+
+/* Controllers whose messages must all arrive: data increment and
+   decrement (96, 97) each step a parameter, and the parameter numbers
+   (98-101) pick the parameter that the data entry after them sets */
+#define IS_STEP_OR_PARAMETER(CONTROL)  (((CONTROL) >= 96U) && ((CONTROL) <= 101U))
+
+
+/* Empty the queue and clear its counters */
+void midi_out_queue_init(MidiOutQueue *queue) {
+  queue->head = 0;
+  queue->tail = 0;
+  queue->in_flight = 0;
+  queue->sent = 0;
+  queue->coalesced = 0;
+  queue->dropped = 0;
+  queue->max_depth = 0;
+}
+
+/* Find a waiting control change that a new one can replace. The search
+   goes from the newest packet back and gives up at anything else sent
+   on the same cable and channel, or at a system message, so the device
+   never sees messages in a different order (e.g. the pedal lifted
+   before a key that was pressed while it was down, or the parts of a
+   registered parameter number) */
+static MIDI_Packet *midi_out_queue_find_control(MidiOutQueue *queue, const MIDI_Packet *packet) {
+  MIDI_Packet *waiting_p;
+  uint32_t index = queue->head;
+
+  while (index != queue->tail) {
+    --index;
+    waiting_p = &queue->packets[index & (MIDI_OUT_QUEUE_SIZE - 1)];
+
+    if (GET_CN(waiting_p->header) != GET_CN(packet->header)) {
+      continue;
+    }
+    if ((waiting_p->header == packet->header) && (waiting_p->byte1 == packet->byte1) &&
+        (waiting_p->byte2 == packet->byte2)) {
+      return waiting_p;
+    }
+    if (!IS_CHANNEL_STATUS(waiting_p->byte1) || ((waiting_p->byte1 & 0xFU) == (packet->byte1 & 0xFU))) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/* Add a packet to the queue, or update a waiting control change for
+   the same controller. Data increment, decrement and the parameter
+   numbers always take their own slot. When the queue is full the
+   packet is dropped and counted */
+MidiQueueStatus midi_out_queue_push(MidiOutQueue *queue, const MIDI_Packet *packet) {
+  MIDI_Packet *waiting_p;
+  uint32_t depth = queue->head - queue->tail;
+
+  if ((GET_CIN(packet->header) == CONTROL_CHANGE) && ((packet->byte1 & 0xF0U) == 0xB0U) &&
+      !IS_STEP_OR_PARAMETER(packet->byte2)) {
+    waiting_p = midi_out_queue_find_control(queue, packet);
+    if (waiting_p != NULL) {
+      waiting_p->byte3 = packet->byte3;
+      ++queue->coalesced;
+      return MIDI_QUEUE_OK;
+    }
+  }
+
+  if (depth >= MIDI_OUT_QUEUE_SIZE) {
+    ++queue->dropped;
+    return MIDI_QUEUE_FULL;
+  }
+
+  queue->packets[queue->head & (MIDI_OUT_QUEUE_SIZE - 1)] = *packet;
+  ++queue->head;
+  if (depth + 1 > queue->max_depth) {
+    queue->max_depth = depth + 1;
+  }
+
+  return MIDI_QUEUE_OK;
+}
+
+/* Move the oldest packets into a transfer buffer of size bytes, as
+   many as fit. Returns the number of bytes to send. The packets are
+   only counted as sent once the transfer is complete */
+uint16_t midi_out_queue_pack(MidiOutQueue *queue, uint8_t *buffer, uint16_t size) {
+  MIDI_Packet *packet_p = (MIDI_Packet*)buffer;
+  uint32_t count = queue->head - queue->tail;
+
+  if (count > size / 4U) {
+    count = size / 4U;
+  }
+  queue->in_flight += count;
+
+  while (count--) {
+    *packet_p++ = queue->packets[queue->tail & (MIDI_OUT_QUEUE_SIZE - 1)];
+    ++queue->tail;
+  }
+
+  return (uint16_t)((uint8_t*)packet_p - buffer);
+}
+
+/* The transfers packed so far have reached the device */
+void midi_out_queue_complete(MidiOutQueue *queue) {
+  queue->sent += queue->in_flight;
+  queue->in_flight = 0;
+}
+
+/* Throw away the waiting packets, e.g. when the device is gone. They
+   are counted as dropped, and so is a transfer that never completed */
+void midi_out_queue_clear(MidiOutQueue *queue) {
+  queue->dropped += queue->head - queue->tail + queue->in_flight;
+  queue->in_flight = 0;
+  queue->tail = queue->head;
+}
+
+/* Get the number of packets waiting to be sent */
+uint32_t midi_out_queue_depth(MidiOutQueue *queue) {
+  return queue->head - queue->tail;
+}
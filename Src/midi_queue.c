@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "midi_queue.h"
+#include "stm32f4xx.h"
+
+
+/* Empty the queue and clear its counters. Must be called before
+   either side starts using the queue */
+void midi_queue_init(MidiQueue *queue) {
+  queue->head = 0;
+  queue->tail = 0;
+  queue->dropped = 0;
+  queue->max_depth = 0;
+}
+
+/* Producer side: copy an event into the queue. When the queue is
+   full the event is dropped and counted */
+MidiQueueStatus midi_queue_push(MidiQueue *queue, const MidiEvent *event) {
+  uint32_t head = queue->head;
+  uint32_t depth = head - queue->tail;
+
+  if (depth >= MIDI_QUEUE_SIZE) {
+    ++queue->dropped;
+    return MIDI_QUEUE_FULL;
+  }
+
+  queue->events[head & (MIDI_QUEUE_SIZE - 1)] = *event;
+  if (depth + 1 > queue->max_depth) {
+    queue->max_depth = depth + 1;
+  }
+
+  /* The event must be stored before the consumer can see it */
+  __DMB();
+  queue->head = head + 1;
+
+  return MIDI_QUEUE_OK;
+}
+
+/* Consumer side: copy the oldest event without removing it */
+MidiQueueStatus midi_queue_peek(MidiQueue *queue, MidiEvent *event) {
+  uint32_t tail = queue->tail;
+
+  if (tail == queue->head) {
+    return MIDI_QUEUE_EMPTY;
+  }
+
+  /* The event must not be read before the head that published it */
+  __DMB();
+  *event = queue->events[tail & (MIDI_QUEUE_SIZE - 1)];
+
+  return MIDI_QUEUE_OK;
+}
+
+/* Consumer side: copy the oldest event out of the queue */
+MidiQueueStatus midi_queue_pop(MidiQueue *queue, MidiEvent *event) {
+  uint32_t tail = queue->tail;
+
+  if (tail == queue->head) {
+    return MIDI_QUEUE_EMPTY;
+  }
+
+  /* The event must not be read before the head that published it */
+  __DMB();
+  *event = queue->events[tail & (MIDI_QUEUE_SIZE - 1)];
+
+  /* The event must be read before the producer can reuse the slot */
+  __DMB();
+  queue->tail = tail + 1;
+
+  return MIDI_QUEUE_OK;
+}
+
+/* Get the number of events waiting in the queue */
+uint32_t midi_queue_depth(MidiQueue *queue) {
+  return queue->head - queue->tail;
+}
@@ -74,6 +74,17 @@ static USBH_StatusTypeDef usbh_midi_interface_init(USBH_HandleTypeDef *phost) {
     }
 
     midi_handle->state = MIDI_IDLE_STATE;
+    midi_handle->tx_data_state = MIDI_IDLE_DATA;
+    midi_handle->rx_data_state = MIDI_IDLE_DATA;
+    midi_handle->rx_armed = 0;
+
+    /* Reads go into a packet buffer of the driver */
+    if (midi_handle->data_itf.in_ep_size > USBH_MIDI_MAX_PACKET_SIZE) {
+      USBH_DbgLog("IN endpoint of %s class is larger than a full speed packet.", phost->pActiveClass->Name);
+      midi_handle->data_itf.in_pipe = 0;
+      midi_handle->data_itf.out_pipe = 0;
+      return USBH_FAIL;
+    }
 
     /* Allocate and open a channel for the endpoints */
     midi_handle->data_itf.in_pipe = USBH_AllocPipe(phost, midi_handle->data_itf.in_ep);
@@ -177,12 +188,13 @@ static USBH_StatusTypeDef usbh_midi_sof_process(USBH_HandleTypeDef *phost) {
   return USBH_OK;
 }
 
-/* Get the size of the last MIDI reception */
+/* Get the size of the last MIDI reception, which can span several
+   packets */
 uint16_t usbh_midi_last_rx_size(USBH_HandleTypeDef *phost) {
   MIDI_HandleTypeDef *midi_handle = phost->pActiveClass->pData;
 
   if (phost->gState == HOST_CLASS) {
-    return USBH_LL_GetLastXferSize(phost, midi_handle->data_itf.in_pipe);
+    return midi_handle->rx_data_count;
   } else {
     return 0;
   }
@@ -194,6 +206,7 @@ USBH_StatusTypeDef usbh_midi_stop(USBH_HandleTypeDef *phost) {
 
   if (phost->gState == HOST_CLASS) {
     midi_handle->state = MIDI_IDLE_STATE;
+    midi_handle->rx_armed = 0;
 
     USBH_ClosePipe(phost, midi_handle->data_itf.in_pipe);
     USBH_ClosePipe(phost, midi_handle->data_itf.out_pipe);
@@ -202,23 +215,31 @@ USBH_StatusTypeDef usbh_midi_stop(USBH_HandleTypeDef *phost) {
   return USBH_OK;
 }
 
-/* Notify state machine that data needs to be transmitted */
+/* Notify state machine that data needs to be transmitted. Returns
+   USBH_BUSY while the previous transmission is still in progress */
 USBH_StatusTypeDef usbh_midi_transmit(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length) {
   MIDI_HandleTypeDef *midi_handle = phost->pActiveClass->pData;
   USBH_StatusTypeDef status = USBH_BUSY;
 
-  if ((midi_handle->state == MIDI_IDLE_STATE) || (midi_handle->state == MIDI_TRANSFER_DATA)) {
+  if (((midi_handle->state == MIDI_IDLE_STATE) || (midi_handle->state == MIDI_TRANSFER_DATA)) &&
+      (midi_handle->tx_data_state == MIDI_IDLE_DATA)) {
     midi_handle->tx_data_p = pbuff;
     midi_handle->tx_data_length = length;
     midi_handle->state = MIDI_TRANSFER_DATA;
     midi_handle->tx_data_state = MIDI_SEND_DATA;
     status = USBH_OK;
+
+    /* Start sending right away, like usbh_midi_receive */
+    if (phost->gState == HOST_CLASS) {
+      midi_process_tx(phost);
+    }
   }
 
   return status;
 }
 
-/* Notify state machine that data needs to be received */
+/* Notify state machine that data needs to be received. The buffer must
+   hold at least one packet of the IN endpoint */
 USBH_StatusTypeDef usbh_midi_receive(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length) {
   MIDI_HandleTypeDef *midi_handle = phost->pActiveClass->pData;
   USBH_StatusTypeDef status = USBH_BUSY;
@@ -226,9 +247,17 @@ USBH_StatusTypeDef usbh_midi_receive(USBH_HandleTypeDef *phost, uint8_t *pbuff,
   if ((midi_handle->state == MIDI_IDLE_STATE) || (midi_handle->state == MIDI_TRANSFER_DATA)) {
     midi_handle->rx_data_p = pbuff;
     midi_handle->rx_data_length = length;
+    midi_handle->rx_data_count = 0;
     midi_handle->state = MIDI_TRANSFER_DATA;
     midi_handle->rx_data_state = MIDI_RECEIVE_DATA;
     status = USBH_OK;
+
+    /* Start the transfer right away instead of on the next pass of
+       the state machine, so the pipe is polled while the caller is
+       still busy with the previous data */
+    if (phost->gState == HOST_CLASS) {
+      midi_process_rx(phost);
+    }
   }
 
   return status;
@@ -286,7 +315,12 @@ static void midi_process_tx(USBH_HandleTypeDef *phost) {
   }
 }
 
-/* Function for receiving MIDI data from device */
+/* Function for receiving MIDI data from device. Every read of the IN
+   pipe goes into the driver's own packet buffer and is copied into the
+   caller's buffer once it completes. That way a read can stay armed
+   after the batch it was started for has been handed over, and the
+   pipe never has to be halted, which the channel only does some time
+   later and not at all if a NAK comes in meanwhile */
 static void midi_process_rx(USBH_HandleTypeDef *phost) {
   MIDI_HandleTypeDef *midi_handle = phost->pActiveClass->pData;
   USBH_URBStateTypeDef urb_status = USBH_URB_IDLE;
@@ -294,11 +328,16 @@ static void midi_process_rx(USBH_HandleTypeDef *phost) {
 
   switch (midi_handle->rx_data_state) {
     case MIDI_RECEIVE_DATA:
-      USBH_BulkReceiveData(phost,
-                          midi_handle->rx_data_p,
-                          midi_handle->data_itf.in_ep_size,
-                          midi_handle->data_itf.in_pipe);
+      /* A read left armed by the last batch goes on into this one */
+      if (!midi_handle->rx_armed) {
+        USBH_BulkReceiveData(phost,
+                            midi_handle->rx_packet,
+                            midi_handle->data_itf.in_ep_size,
+                            midi_handle->data_itf.in_pipe);
+        midi_handle->rx_armed = 1;
+      }
 
+      midi_handle->rx_frame = phost->Timer;
       midi_handle->rx_data_state = MIDI_RECEIVE_DATA_WAIT;
       break;
 
@@ -308,16 +347,30 @@ static void midi_process_rx(USBH_HandleTypeDef *phost) {
       /* Wait for data reception to complete */
       if (urb_status == USBH_URB_DONE) {
         length = USBH_LL_GetLastXferSize(phost, midi_handle->data_itf.in_pipe);
-
-        if (((midi_handle->rx_data_length - length) > 0) && (length > midi_handle->data_itf.in_ep_size)) {
-          /* If rx data size is larger than the max packet size, get next chunk */
-          midi_handle->rx_data_length -= length;
-          midi_handle->rx_data_p += length;
+        memcpy(midi_handle->rx_data_p, midi_handle->rx_packet, length);
+        midi_handle->rx_armed = 0;
+        midi_handle->rx_data_count += length;
+        midi_handle->rx_data_length -= length;
+        midi_handle->rx_data_p += length;
+
+        if ((length == midi_handle->data_itf.in_ep_size) &&
+            (midi_handle->rx_data_length >= midi_handle->data_itf.in_ep_size)) {
+          /* A full packet means the device may have more to send, so
+             keep reading into the buffer while another packet fits */
           midi_handle->rx_data_state = MIDI_RECEIVE_DATA;
+          midi_process_rx(phost);
         } else {
           midi_handle->rx_data_state = MIDI_IDLE_DATA;
           usbh_midi_rx_callback(phost);
         }
+      } else if ((midi_handle->rx_data_count > 0) &&
+                 ((urb_status == USBH_URB_NOTREADY) || (phost->Timer != midi_handle->rx_frame))) {
+        /* The device NAKed the read after a full packet, or the next
+           frame started without an answer (Timer counts the SOFs). Hand
+           over the batch so far instead of holding its events until the
+           device sends again. The read stays armed for the next batch */
+        midi_handle->rx_data_state = MIDI_IDLE_DATA;
+        usbh_midi_rx_callback(phost);
       }
       break;
 
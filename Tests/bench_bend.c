@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host benchmark of the cost of moving the pitch wheel. A ten-note
+   chord rings while every section is rendered in a few spans, the way
+   the player splits it at the frames of the events. The same sections
+   are timed with the wheel held still and with the wheel moved before
+   every span, which retunes every voice. The difference is the cost of
+   the retunes, reported per voice and span. Each figure is the best of
+   a number of runs. The timings are host figures and only useful to
+   compare builds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+
+#define CHORD_SIZE       10U
+#define NUM_OF_RUNS      50U
+#define NUM_OF_SECTIONS  200U
+#define SPANS            8U
+#define VELOCITY         100U
+
+static InstrumentModel model;
+
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Start the chord on the lowest alternate keys, which stay active for
+   the whole run */
+static void start_chord(void) {
+  uint32_t note_index;
+  uint32_t i;
+
+  instrument_model_init(&model);
+  for (i = 0; i < CHORD_SIZE; ++i) {
+    note_index = NUM_OF_NOTES - 1U - 2U * i;
+    instrument_model_note_on(&model, (uint8_t)(MIDI_NOTE_OFFSET - note_index), VELOCITY,
+                             note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                             note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                             note_bend_delays[note_index]);
+  }
+}
+
+/* Render the sections in spans and move the wheel before every span
+   if asked to. The wheel sweeps up and down over its whole range */
+static double play(uint8_t move_wheel) {
+  uint32_t position = 0;
+  uint32_t section;
+  uint32_t span;
+  double start;
+
+  start_chord();
+  start = now();
+  for (section = 0; section < NUM_OF_SECTIONS; ++section) {
+    section_ready = (section & 1U) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+    instrument_model_begin(&model);
+    for (span = 1; span <= SPANS; ++span) {
+      if (move_wheel) {
+        position = (position + 1031U) % 32768U;
+        instrument_model_bend(&model, (uint16_t)((position < 16384U) ? position : (32767U - position)));
+      }
+      instrument_model_render_to(&model, span * AUDIO_PERIOD_SIZE / SPANS);
+    }
+    instrument_model_end(&model);
+  }
+  return now() - start;
+}
+
+
+int main(void) {
+  double still = 1e9;
+  double moving = 1e9;
+  double time;
+  uint32_t run;
+
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    time = play(0);
+    still = (time < still) ? time : still;
+    time = play(1);
+    moving = (time < moving) ? time : moving;
+  }
+
+  printf("bench_bend: %u-note chord, %u spans per section of %u frames\n", CHORD_SIZE, SPANS,
+         AUDIO_PERIOD_SIZE);
+  printf("  wheel still:  %8.0f ns/section\n", still * 1e9 / NUM_OF_SECTIONS);
+  printf("  wheel moving: %8.0f ns/section\n", moving * 1e9 / NUM_OF_SECTIONS);
+  printf("  retune:       %8.1f ns/voice/span\n",
+         (moving - still) * 1e9 / (NUM_OF_SECTIONS * SPANS * CHORD_SIZE));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host benchmark of the USB-MIDI decoder. A stream of 1M synthetic
+   packets is made to look like a keyboard that sends its clock: 55%
+   clock, 5% active sensing and the rest notes (some with velocity 0),
+   control changes, channel pressure, pitch bend, sysex and a second
+   cable, on two channels. The decoder listens to one channel for the
+   four types the player handles, and the number of events has to match
+   a count made while the stream is generated. The hash of the events
+   shows whether two builds decode the same. The timings are host
+   figures and only useful to compare builds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "midi_decoder.h"
+
+#define NUM_OF_PACKETS  (1U << 20)
+#define NUM_OF_RUNS     20U
+
+static MIDI_Packet packets[NUM_OF_PACKETS];
+static uint32_t random_state = 1U;
+
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t random_next(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/* Fill the stream and count the packets that the decoder should turn
+   into events */
+static uint32_t make_stream(void) {
+  MIDI_Packet *packet;
+  uint32_t expected = 0;
+  uint32_t kind;
+  uint32_t x;
+  uint8_t channel;
+  uint8_t data1;
+  uint8_t data2;
+  uint8_t on;
+  uint32_t i;
+
+  for (i = 0; i < NUM_OF_PACKETS; ++i) {
+    packet = &packets[i];
+    x = random_next();
+    kind = x % 100U;
+    channel = (uint8_t)((x >> 8) & 1U);
+    data1 = (uint8_t)((x >> 12) & 0x7FU);
+    data2 = (uint8_t)((x >> 20) & 0x7FU);
+
+    if (kind < 55U) {
+      *packet = (MIDI_Packet){0x0F, 0xF8, 0, 0};
+    } else if (kind < 60U) {
+      *packet = (MIDI_Packet){0x0F, 0xFE, 0, 0};
+    } else if (kind < 75U) {
+      on = (uint8_t)((x >> 28) & 1U);
+      *packet = (MIDI_Packet){on ? 0x09 : 0x08, (uint8_t)((on ? 0x90 : 0x80) | channel), data1,
+                              ((x >> 27) & 1U) ? 0 : data2};
+    } else if (kind < 85U) {
+      *packet = (MIDI_Packet){0x0B, (uint8_t)(0xB0 | channel), data1, data2};
+    } else if (kind < 90U) {
+      *packet = (MIDI_Packet){0x0D, (uint8_t)(0xD0 | channel), data1, 0};
+    } else if (kind < 95U) {
+      *packet = (MIDI_Packet){0x0E, (uint8_t)(0xE0 | channel), data1, data2};
+    } else if (kind < 98U) {
+      *packet = (MIDI_Packet){0x04, 0xF0, 0x7E, 0x7F};
+    } else {
+      *packet = (MIDI_Packet){0x19, (uint8_t)(0x90 | channel), data1, data2};
+    }
+
+    if (((packet->header >> 4) == 0) && (channel == 0) &&
+        (((packet->header & 0xFU) == 0x8U) || ((packet->header & 0xFU) == 0x9U) ||
+         ((packet->header & 0xFU) == 0xBU) || ((packet->header & 0xFU) == 0xEU))) {
+      ++expected;
+    }
+  }
+
+  return expected;
+}
+
+
+int main(void) {
+  uint64_t event_hash = 1469598103934665603ULL;
+  MidiDecoder decoder;
+  MidiEvent event;
+  uint32_t expected;
+  uint32_t run;
+  uint32_t i;
+  double best = 1e9;
+  double start;
+
+  expected = make_stream();
+
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    midi_decoder_init(&decoder, 0, 0x0001U, MIDI_TYPE_BIT(NOTE_OFF) | MIDI_TYPE_BIT(NOTE_ON) |
+                      MIDI_TYPE_BIT(CONTROL_CHANGE) | MIDI_TYPE_BIT(PITCH_BEND));
+
+    start = now();
+    for (i = 0; i < NUM_OF_PACKETS; ++i) {
+      if (midi_decoder_decode(&decoder, &packets[i], &event) && (run == 0)) {
+        event_hash = (event_hash ^ event.type) * 1099511628211ULL;
+        event_hash = (event_hash ^ event.channel) * 1099511628211ULL;
+        event_hash = (event_hash ^ event.data1) * 1099511628211ULL;
+        event_hash = (event_hash ^ event.data2) * 1099511628211ULL;
+      }
+    }
+    start = now() - start;
+    if (start < best) {
+      best = start;
+    }
+  }
+
+  printf("bench_midi_decoder: %u packets, %u events (%u expected), %u real-time, %u filtered, %u invalid\n",
+         NUM_OF_PACKETS, decoder.decoded, expected, decoder.realtime, decoder.filtered, decoder.invalid);
+  printf("  %.2f ns/packet, %.1f M events/s\n", best * 1e9 / NUM_OF_PACKETS, decoder.decoded / best * 1e-6);
+  printf("  event hash:   %016llx\n", (unsigned long long)event_hash);
+
+  return (decoder.decoded == expected) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host model of the MIDI input latency. The class driver runs against
+   the simulated pipes of Tests/host/usbh_core.c on a clock that counts
+   microseconds, with a frame on the bus every millisecond. The main
+   loop runs the class state machine and renders a period whenever one
+   is due, which keeps it busy for a set time. The receive callback
+   stands in for the player's: it decodes each packet of a batch in a
+   set time and queues the next read either before or after decoding.
+
+   The device sends either ten-note chords at random times or a
+   controller about every millisecond, and both orders of the callback
+   get the same events. For every event the time from when the
+   device has it to when it is queued is recorded, and the mean, the
+   99th percentile and the maximum are reported along with how much of
+   the time the IN pipe had no read armed. The figures come from the
+   model and not from a clock, so they are the same on every run. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usbh_midi.h"
+#include "instrument_player.h"
+
+#define FRAME_US          1000U
+#define LOOP_US           2U
+#define DECODE_US         1U
+#define RUN_US            20000000U
+#define CHORD_SIZE        10U
+#define CHORD_GAP_US      83000U
+#define MAX_LATENCY_US    16384U
+#define MAX_EVENTS        (RUN_US / (FRAME_US / 2U))
+
+typedef enum {
+  LOAD_CHORDS = 0,
+  LOAD_CONTROLLER
+} DeviceLoad;
+
+static USBH_HandleTypeDef host;
+static uint8_t rx_buffers[RX_BUFFERS][RX_BUFFER_SIZE];
+static uint8_t rx_buffer = 0;
+static uint8_t arm_first;
+static uint32_t now_us;
+static uint32_t next_frame_us;
+static uint32_t event_times[MAX_EVENTS];
+static uint32_t events_written;
+static uint32_t events_queued;
+static uint32_t next_event_us;
+static DeviceLoad load;
+static uint32_t latencies[MAX_LATENCY_US + 1];
+static uint64_t latency_sum;
+static uint32_t latency_max;
+static uint32_t unarmed_us;
+static uint32_t random_state;
+
+
+static uint32_t random_next(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/* Hand the device the events it has by the given time */
+static void device_events(uint32_t until_us) {
+  static const uint8_t note_on[4] = {0x09, 0x90, 60, 100};
+  static const uint8_t controller[4] = {0x0B, 0xB0, 1, 64};
+  uint32_t i;
+
+  while ((next_event_us < until_us) && (events_written < MAX_EVENTS)) {
+    if (load == LOAD_CHORDS) {
+      for (i = 0; (i < CHORD_SIZE) && (events_written < MAX_EVENTS); ++i) {
+        usbh_core_device_write(note_on, 4);
+        event_times[events_written++] = next_event_us;
+      }
+      next_event_us += CHORD_GAP_US / 2U + random_next() % CHORD_GAP_US;
+    } else {
+      usbh_core_device_write(controller, 4);
+      event_times[events_written++] = next_event_us;
+      next_event_us += FRAME_US / 2U + random_next() % FRAME_US;
+    }
+  }
+}
+
+/* Let time pass. The frames that start meanwhile run on the bus as if
+   from an interrupt, after the device has been given its events */
+static void advance(uint32_t us) {
+  MIDI_HandleTypeDef *midi_handle = host.pActiveClass->pData;
+  uint32_t step;
+
+  while (us > 0) {
+    step = next_frame_us - now_us;
+    if (step > us) {
+      step = us;
+    }
+    if (!midi_handle->rx_armed) {
+      unarmed_us += step;
+    }
+    now_us += step;
+    us -= step;
+
+    if (now_us == next_frame_us) {
+      device_events(now_us);
+      usbh_core_frame(&host);
+      next_frame_us += FRAME_US;
+    }
+  }
+}
+
+/* Stand-in for the player's receive callback */
+void usbh_midi_rx_callback(USBH_HandleTypeDef *phost) {
+  uint16_t num_of_packets = usbh_midi_last_rx_size(phost) / 4;
+  uint32_t latency;
+
+  rx_buffer = (rx_buffer + 1) % RX_BUFFERS;
+  if (arm_first) {
+    usbh_midi_receive(phost, &rx_buffers[rx_buffer][0], RX_BUFFER_SIZE);
+  }
+
+  while (num_of_packets--) {
+    advance(DECODE_US);
+    latency = now_us - event_times[events_queued++];
+    latency_sum += latency;
+    latency_max = (latency > latency_max) ? latency : latency_max;
+    ++latencies[(latency < MAX_LATENCY_US) ? latency : MAX_LATENCY_US];
+  }
+
+  if (!arm_first) {
+    usbh_midi_receive(phost, &rx_buffers[rx_buffer][0], RX_BUFFER_SIZE);
+  }
+}
+
+/* Run the main loop with the given render time per period and report
+   the latency of the events */
+static void run(DeviceLoad device_load, uint8_t rearm_first, uint32_t render_us) {
+  uint32_t period_us = AUDIO_PERIOD_SIZE * 1000000U / SAMPLE_FREQUENCY;
+  uint32_t next_period_us;
+  uint32_t start_us;
+  uint32_t count;
+  uint32_t p99;
+
+  /* Let the previous run hand over what it left with the device */
+  arm_first = 1;
+  load = LOAD_CONTROLLER;
+  next_event_us = 0xFFFFFFFFU;
+  while (events_queued < events_written) {
+    host.pActiveClass->BgndProcess(&host);
+    advance(LOOP_US);
+  }
+
+  /* Both orders get the same events */
+  random_state = 88172645U;
+  load = device_load;
+  arm_first = rearm_first;
+  events_written = 0;
+  events_queued = 0;
+  latency_sum = 0;
+  latency_max = 0;
+  unarmed_us = 0;
+  memset(latencies, 0, sizeof(latencies));
+  start_us = now_us;
+  next_event_us = now_us + random_next() % FRAME_US;
+  next_period_us = now_us;
+
+  while ((now_us - start_us) < RUN_US) {
+    host.pActiveClass->BgndProcess(&host);
+    advance(LOOP_US);
+    if ((int32_t)(now_us - next_period_us) >= 0) {
+      advance(render_us);
+      next_period_us += period_us;
+    }
+  }
+
+  for (count = 0, p99 = 0; p99 < MAX_LATENCY_US; ++p99) {
+    count += latencies[p99];
+    if (count * 100ULL >= events_queued * 99ULL) {
+      break;
+    }
+  }
+  printf("  %-10s render %4u us, read queued %s decoding: mean %6.1f us, p99 %5u us, max %5u us, "
+         "unarmed %.3f%%\n", (device_load == LOAD_CHORDS) ? "chords" : "controller", render_us,
+         rearm_first ? "before" : "after ", (double)latency_sum / events_queued, p99, latency_max,
+         100.0 * unarmed_us / (now_us - start_us));
+}
+
+
+int main(void) {
+  static const uint32_t render_times[] = {300, 2600};
+  static USBH_ClassTypeDef active_class;
+  uint32_t i;
+
+  active_class = midi_class;
+  host.pActiveClass = &active_class;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[0].bEndpointAddress = 0x81U;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[0].wMaxPacketSize = 64U;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[1].bEndpointAddress = 0x01U;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[1].wMaxPacketSize = 64U;
+  host.pActiveClass->Init(&host);
+  host.gState = HOST_CLASS;
+  next_frame_us = FRAME_US;
+  usbh_midi_receive(&host, &rx_buffers[0][0], RX_BUFFER_SIZE);
+
+  printf("bench_midi_latency: %u s per run, %u us per period, %u us per pass of the main loop, "
+         "%u us per packet decoded\n", RUN_US / 1000000U, AUDIO_PERIOD_SIZE * 1000000U / SAMPLE_FREQUENCY,
+         LOOP_US, DECODE_US);
+  for (i = 0; i < sizeof(render_times) / sizeof(render_times[0]); ++i) {
+    run(LOAD_CHORDS, 0, render_times[i]);
+    run(LOAD_CHORDS, 1, render_times[i]);
+    run(LOAD_CONTROLLER, 0, render_times[i]);
+    run(LOAD_CONTROLLER, 1, render_times[i]);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host benchmark of a chord struck on the player. The ten lowest
+   alternate keys have the longest bursts, so they are the worst case
+   for the note-ons. The chord arrives as one batch of packets while
+   the DMA model plays, and four figures are reported, each the best
+   of a number of runs:
+   - the ten note-ons on their own;
+   - the receive callback that decodes and queues the chord;
+   - the worst section while the chord starts, note-ons included;
+   - a section once the chord rings.
+   The timings are host figures and only useful to compare builds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "instrument_player.h"
+#include "delay_lengths.h"
+#include "midi_device.h"
+
+#define CHORD_SIZE       10U
+#define NUM_OF_RUNS      200U
+#define START_PERIODS    4U
+#define RING_PERIODS     20U
+#define VELOCITY         100U
+
+static USBH_HandleTypeDef host;
+static InstrumentModel model;
+
+
+void error_handler(void) {
+  printf("bench_note_on: error_handler called\n");
+  exit(EXIT_FAILURE);
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t chord_note_index(uint32_t i) {
+  return NUM_OF_NOTES - 1U - 2U * i;
+}
+
+/* Let the DMA read one period and time the render of the half it
+   left free */
+static double play_period(void) {
+  double start;
+  uint32_t i;
+
+  for (i = 0; i < AUDIO_CHANNELS * AUDIO_PERIOD_SIZE; ++i) {
+    audio_out_transfer();
+  }
+
+  start = now();
+  instrument_player_play();
+  return now() - start;
+}
+
+static double keep_best(double best, double time) {
+  return (time < best) ? time : best;
+}
+
+
+int main(void) {
+  MIDI_Packet packets[CHORD_SIZE];
+  double note_ons = 1e9;
+  double callback = 1e9;
+  double chord = 1e9;
+  double ring = 1e9;
+  double worst;
+  double start;
+  uint32_t note_index;
+  uint32_t run;
+  uint32_t i;
+
+  for (i = 0; i < CHORD_SIZE; ++i) {
+    packets[i] = (MIDI_Packet){0x09, 0x90, (uint8_t)(MIDI_NOTE_OFFSET - chord_note_index(i)), VELOCITY};
+  }
+
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    instrument_model_init(&model);
+    start = now();
+    for (i = 0; i < CHORD_SIZE; ++i) {
+      note_index = chord_note_index(i);
+      instrument_model_note_on(&model, (uint8_t)(MIDI_NOTE_OFFSET - note_index), VELOCITY,
+                               note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                               note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                               note_bend_delays[note_index]);
+    }
+    note_ons = keep_best(note_ons, now() - start);
+  }
+
+  /* The player has its own model, which shares the delay lines with
+     the one above, so it only starts once that one is done */
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    instrument_player_init();
+    instrument_player_start_midi(&host);
+    play_period();
+    play_period();
+
+    start = now();
+    if (midi_device_send(&host, packets, CHORD_SIZE) != USBH_OK) {
+      error_handler();
+    }
+    callback = keep_best(callback, now() - start);
+
+    worst = 0.0;
+    for (i = 0; i < START_PERIODS; ++i) {
+      start = play_period();
+      worst = (start > worst) ? start : worst;
+    }
+    chord = keep_best(chord, worst);
+
+    for (i = START_PERIODS; i < RING_PERIODS; ++i) {
+      play_period();
+    }
+    ring = keep_best(ring, play_period());
+  }
+
+  printf("bench_note_on: %u-note chord, %u frames per section\n", CHORD_SIZE, AUDIO_PERIOD_SIZE);
+  printf("  note-ons:         %8.0f ns\n", note_ons * 1e9);
+  printf("  receive callback: %8.0f ns\n", callback * 1e9);
+  printf("  chord section:    %8.0f ns\n", chord * 1e9);
+  printf("  ringing section:  %8.0f ns\n", ring * 1e9);
+
+  return EXIT_SUCCESS;
+}
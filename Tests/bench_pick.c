@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host benchmark of the cost of a note with the pick position comb.
+   A few keys are played with the comb off and with the string plucked
+   at a quarter of its length. The note-on itself is timed, and so are
+   the sections that copy the burst through the comb, which is where
+   the comb costs anything. Each figure is the best of a number of
+   runs. The timings are host figures and only useful to compare
+   builds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+
+#define NUM_OF_RUNS      300U
+#define VELOCITY         100U
+#define PICK_QUARTER     8192U
+
+static InstrumentModel model;
+
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Time the note-on and the sections that copy its burst, keeping the
+   best of each */
+static void play(uint32_t note_index, uint16_t pick_position, double *note_on, double *burst) {
+  uint32_t sections = note_delay_lengths[note_index] / AUDIO_PERIOD_SIZE + 1U;
+  double start;
+  uint32_t run;
+  uint32_t i;
+
+  *note_on = 1e9;
+  *burst = 1e9;
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    instrument_model_init(&model);
+    instrument_model_pick(&model, pick_position);
+
+    start = now();
+    instrument_model_note_on(&model, (uint8_t)(MIDI_NOTE_OFFSET - note_index), VELOCITY,
+                             note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                             note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                             note_bend_delays[note_index]);
+    start = now() - start;
+    *note_on = (start < *note_on) ? start : *note_on;
+
+    start = now();
+    for (i = 0; i < sections; ++i) {
+      section_ready = (i & 1U) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+      instrument_model_process(&model);
+    }
+    start = now() - start;
+    *burst = (start < *burst) ? start : *burst;
+  }
+}
+
+
+int main(void) {
+  static const uint32_t keys[] = {0, 39, 87};
+  static const char *names[] = {"C8", "A4", "A0"};
+  double note_on[2];
+  double burst[2];
+  char label[16];
+  uint32_t note_index;
+  uint32_t i;
+
+  printf("bench_pick: pick position off and at a quarter of the string, %u frames per section\n",
+         AUDIO_PERIOD_SIZE);
+  for (i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    note_index = keys[i];
+    play(note_index, 0, &note_on[0], &burst[0]);
+    play(note_index, PICK_QUARTER, &note_on[1], &burst[1]);
+    snprintf(label, sizeof(label), "%s (D=%u):", names[i], note_delay_lengths[note_index]);
+    printf("  %-12s note-on %3.0f ns off, %3.0f ns comb; burst over %2u sections %5.0f ns off, %5.0f ns comb\n",
+           label, note_on[0] * 1e9, note_on[1] * 1e9, note_delay_lengths[note_index] / AUDIO_PERIOD_SIZE + 1U,
+           burst[0] * 1e9, burst[1] * 1e9);
+  }
+
+  return EXIT_SUCCESS;
+}
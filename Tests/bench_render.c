@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host benchmark of the render path. Every key is played on its own
+   and then as part of a chord that fills the voice pool, and the time
+   spent in instrument_model_process() is reported per rendered frame.
+   The throughput of a single voice is also given for the shortest
+   delay (C8) and the longest one (A0), over the first sections while
+   even C8 is still ringing.
+   The hash of the last buffer only changes when the sound does, so it
+   also shows whether two builds of the kernels give the same output.
+
+   For every entry of note_delay_lengths the span kernel is also timed
+   against the per-sample loop it replaced, which masks the index of
+   every tap. Both run the same delay line filled with noise, and the
+   benchmark fails if they do not write the same samples. The timings
+   are host figures and only useful to compare builds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+
+#define NUM_OF_SECTIONS  400U
+#define NOTE_SECTIONS    100U
+#define NUM_OF_RUNS      5U
+#define VELOCITY         100U
+#define KERNEL_FRAMES    (1U << 16)
+
+static InstrumentModel model;
+static uint64_t output_hash = 1469598103934665603ULL;
+static int16_t span_memory[DELAY_LINE_SIZE];
+static int16_t sample_memory[DELAY_LINE_SIZE];
+
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void play(uint32_t note_index) {
+  instrument_model_note_on(&model, (uint8_t)(MIDI_NOTE_OFFSET - note_index), VELOCITY,
+                           note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                           note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                           note_bend_delays[note_index]);
+}
+
+/* Render a number of sections and return the best time per section
+   out of a few runs, starting each run from the same notes */
+static double render(const uint32_t *notes, uint32_t count, uint32_t sections) {
+  double best = 1e9;
+  double start;
+  uint32_t run;
+  uint32_t i;
+
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    instrument_model_init(&model);
+    for (i = 0; i < count; ++i) {
+      play(notes[i]);
+    }
+
+    start = now();
+    for (i = 0; i < sections; ++i) {
+      section_ready = (i & 1U) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+      instrument_model_process(&model);
+    }
+    start = now() - start;
+    if (start < best) {
+      best = start;
+    }
+  }
+
+  return best / sections;
+}
+
+/* Add the last buffer to the output hash */
+static void hash_output(void) {
+  uint32_t i;
+
+  for (i = 0; i < model.buffer_len; ++i) {
+    output_hash = (output_hash ^ (uint16_t)model.audio_p[i]) * 1099511628211ULL;
+  }
+}
+
+/* The filter loop of instrument_model_render(), without the mix */
+static void render_spans(int16_t *mem_p, uint32_t delay, KsCoeffs coeffs) {
+  uint32_t index_limit = DELAY_LINE_SIZE - 1;
+  uint32_t chunk_len = delay;
+  uint32_t frames = KERNEL_FRAMES;
+  uint32_t rw_index = 0;
+  uint32_t tap_index;
+  uint32_t span;
+  int16_t taps[3];
+  uint32_t i;
+
+  if (chunk_len > (DELAY_LINE_SIZE - delay - 2)) {
+    chunk_len = DELAY_LINE_SIZE - delay - 2;
+  }
+
+  while (frames > 0) {
+    tap_index = (rw_index - delay - 2) & index_limit;
+
+    span = DELAY_LINE_SIZE - rw_index;
+    if (span > frames) {
+      span = frames;
+    }
+    if (tap_index >= (index_limit - 1)) {
+      span = 0;
+    } else if (span > (index_limit - 1 - tap_index)) {
+      span = index_limit - 1 - tap_index;
+    }
+
+    if (span == 0) {
+      for (i = 0; i < 3; ++i) {
+        taps[i] = mem_p[(tap_index + i) & index_limit];
+      }
+      mem_p[rw_index] = dsp_ks_frac(taps, coeffs);
+      span = 1;
+    } else {
+      dsp_ks_run(&mem_p[rw_index], &mem_p[tap_index], span, chunk_len, coeffs);
+    }
+
+    rw_index = (rw_index + span) & index_limit;
+    frames -= span;
+  }
+}
+
+/* The per-sample loop that the span kernel replaced */
+static void render_samples(int16_t *mem_p, uint32_t delay, KsCoeffs coeffs) {
+  uint32_t index_limit = DELAY_LINE_SIZE - 1;
+  uint32_t rw_index = 0;
+  int16_t taps[3];
+  uint32_t frame;
+
+  for (frame = 0; frame < KERNEL_FRAMES; ++frame) {
+    taps[0] = mem_p[(rw_index - delay - 2) & index_limit];
+    taps[1] = mem_p[(rw_index - delay - 1) & index_limit];
+    taps[2] = mem_p[(rw_index - delay) & index_limit];
+    mem_p[rw_index] = dsp_ks_frac(taps, coeffs);
+    rw_index = (rw_index + 1) & index_limit;
+  }
+}
+
+/* Time both kernels on the delay of one note and check that they give
+   the same samples. Returns the speed-up of the span kernel, or zero
+   if the outputs differ */
+static double compare_kernels(uint32_t note_index) {
+  KsCoeffs coeffs = dsp_ks_coeffs(note_frac_coeffs[note_index], note_stretch_coeffs[note_index],
+                                  note_loss_coeffs[note_index]);
+  uint32_t delay = note_delay_lengths[note_index];
+  uint32_t random_state = 1U + note_index;
+  double span_best = 1e9;
+  double sample_best = 1e9;
+  double start;
+  uint32_t run;
+
+  for (run = 0; run < NUM_OF_RUNS; ++run) {
+    dsp_noise_run(span_memory, DELAY_LINE_SIZE, &random_state);
+    memcpy(sample_memory, span_memory, sizeof(span_memory));
+
+    start = now();
+    render_spans(span_memory, delay, coeffs);
+    start = now() - start;
+    if (start < span_best) {
+      span_best = start;
+    }
+
+    start = now();
+    render_samples(sample_memory, delay, coeffs);
+    start = now() - start;
+    if (start < sample_best) {
+      sample_best = start;
+    }
+
+    if (memcmp(span_memory, sample_memory, sizeof(span_memory)) != 0) {
+      printf("  D=%-4u spans and per-sample loop differ\n", delay);
+      return 0.0;
+    }
+  }
+
+  printf("  D=%-4u %6.2f ns/frame spans, %6.2f ns/frame per sample, x%.2f\n", delay,
+         span_best * 1e9 / KERNEL_FRAMES, sample_best * 1e9 / KERNEL_FRAMES, sample_best / span_best);
+  return sample_best / span_best;
+}
+
+
+int main(void) {
+  double note_times[2];
+  uint32_t notes[MAX_VOICES];
+  double single = 0.0;
+  double chord = 0.0;
+  double speed_up;
+  double worst = 1e9;
+  uint32_t i;
+  uint32_t j;
+
+  for (i = 0; i < NUM_OF_NOTES; ++i) {
+    single += render(&i, 1, NUM_OF_SECTIONS);
+    hash_output();
+  }
+
+  for (i = 0; i < NUM_OF_NOTES; ++i) {
+    for (j = 0; j < MAX_VOICES; ++j) {
+      notes[j] = (i + j * 11U) % NUM_OF_NOTES;
+    }
+    chord += render(notes, MAX_VOICES, NUM_OF_SECTIONS);
+    hash_output();
+  }
+
+  i = 0;
+  note_times[0] = render(&i, 1, NOTE_SECTIONS);
+  i = NUM_OF_NOTES - 1;
+  note_times[1] = render(&i, 1, NOTE_SECTIONS);
+
+  printf("bench_render: %u frames per section\n", AUDIO_PERIOD_SIZE);
+  printf("  one voice:    %.2f ns/frame\n", single * 1e9 / (NUM_OF_NOTES * AUDIO_PERIOD_SIZE));
+  printf("  %u voices:   %.2f ns/frame/voice\n", MAX_VOICES,
+         chord * 1e9 / (NUM_OF_NOTES * AUDIO_PERIOD_SIZE * MAX_VOICES));
+  printf("  C8 (D=%u):  %.2f ns/frame, %.1f M frames/s\n", note_delay_lengths[0],
+         note_times[0] * 1e9 / AUDIO_PERIOD_SIZE, AUDIO_PERIOD_SIZE / note_times[0] * 1e-6);
+  printf("  A0 (D=%u): %.2f ns/frame, %.1f M frames/s\n", note_delay_lengths[NUM_OF_NOTES - 1],
+         note_times[1] * 1e9 / AUDIO_PERIOD_SIZE, AUDIO_PERIOD_SIZE / note_times[1] * 1e-6);
+  printf("  output hash:  %016llx\n", (unsigned long long)output_hash);
+
+  printf("bench_render: span kernel against the per-sample loop\n");
+  for (i = 0; i < NUM_OF_NOTES; ++i) {
+    speed_up = compare_kernels(i);
+    if (speed_up < worst) {
+      worst = speed_up;
+    }
+  }
+  printf("  worst speed-up x%.2f\n", worst);
+
+  return (worst > 0.0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host render that sweeps the velocity from 1 to 127 on every key.
+   Each note starts from silent delay lines and is rendered for as
+   long as its burst is being copied and one section more. No section
+   may peak above the gain of the velocity curve, and the mix load has
+   to be that gain. The mean peak of the first section is reported for
+   a few velocities, along with the time per frame of the whole sweep.
+   The hash of the output shows whether two builds give the same sound.
+   The timings are host figures and only useful to compare builds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+#include "excitation_bursts.h"
+
+static InstrumentModel model;
+static uint32_t section;
+static long failures;
+
+
+static void fail(const char *what, uint32_t note, uint32_t velocity) {
+  if (failures < 10) {
+    printf("bench_velocity: %s (note %u, velocity %u)\n", what, note, velocity);
+  }
+  ++failures;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Render one section and return its peak */
+static int32_t render(uint64_t *hash) {
+  int32_t peak = 0;
+  int32_t sample;
+  uint32_t i;
+
+  section_ready = (section++ & 1U) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+  instrument_model_process(&model);
+
+  for (i = 0; i < AUDIO_CHANNELS * AUDIO_PERIOD_SIZE; ++i) {
+    sample = model.section_p[i];
+    *hash = (*hash ^ (uint16_t)sample) * 1099511628211ULL;
+    peak = (sample > peak) ? sample : ((-sample > peak) ? -sample : peak);
+  }
+  return peak;
+}
+
+
+int main(void) {
+  static const uint32_t shown[] = {1, 32, 64, 100, 127};
+  uint64_t output_hash = 1469598103934665603ULL;
+  double first_peaks[128] = {0.0};
+  uint32_t frames = 0;
+  uint32_t note_index;
+  uint32_t velocity;
+  uint32_t sections;
+  uint32_t gain;
+  int32_t peak;
+  double start;
+  uint32_t i;
+
+  start = now();
+  for (note_index = 0; note_index < NUM_OF_NOTES; ++note_index) {
+    for (velocity = 1; velocity < 128U; ++velocity) {
+      instrument_model_init(&model);
+      for (i = 0; i < MAX_VOICES; ++i) {
+        memset(model.voices[i].memory.mem_p, 0, model.voices[i].memory.mem_len * sizeof(int16_t));
+      }
+      instrument_model_note_on(&model, (uint8_t)(MIDI_NOTE_OFFSET - note_index), (uint8_t)velocity,
+                               note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                               note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                               note_bend_delays[note_index]);
+      gain = excitation_velocity_gains[velocity];
+
+      sections = note_delay_lengths[note_index] / AUDIO_PERIOD_SIZE + 2U;
+      for (i = 0; i < sections; ++i) {
+        peak = render(&output_hash);
+        if (i == 0) {
+          first_peaks[velocity] += peak;
+          if (model.mix_load != gain) {
+            fail("mix load is not the gain of the velocity", MIDI_NOTE_OFFSET - note_index, velocity);
+          }
+        }
+        if ((uint32_t)peak > gain) {
+          fail("section peaks above the gain of the velocity", MIDI_NOTE_OFFSET - note_index, velocity);
+        }
+      }
+      frames += sections * AUDIO_PERIOD_SIZE;
+    }
+  }
+  start = now() - start;
+
+  printf("bench_velocity: %u keys at velocities 1 to 127, %u frames\n", NUM_OF_NOTES, frames);
+  for (i = 0; i < sizeof(shown) / sizeof(shown[0]); ++i) {
+    printf("  velocity %3u: gain %5u, mean first peak %5.0f\n", shown[i],
+           excitation_velocity_gains[shown[i]], first_peaks[shown[i]] / NUM_OF_NOTES);
+  }
+  printf("  %.2f ns/frame\n", start * 1e9 / frames);
+  printf("  output hash:  %016llx\n", (unsigned long long)output_hash);
+  printf("bench_velocity: %ld failures\n", failures);
+
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include "audio_out.h"
+
+
+static int16_t *buffer_p = NULL;
+static uint32_t buffer_len = 0;
+static uint32_t remaining = 0;
+static uint8_t hold_callbacks = 0;
+static void (*pending_callback)(void) = NULL;
+
+
+uint8_t audio_out_init(uint16_t output_device, uint8_t volume, uint32_t audio_freq) {
+  return AUDIO_OK;
+}
+
+/* Start the circular transfer of the whole buffer. size is in bytes */
+uint8_t audio_out_play(int16_t *pbuffer, uint32_t size) {
+  if ((pbuffer == NULL) || (size < 4U) || ((size / 2U) > 0xFFFFU)) {
+    return AUDIO_ERROR;
+  }
+
+  buffer_p = pbuffer;
+  buffer_len = size / 2U;
+  remaining = buffer_len;
+
+  return AUDIO_OK;
+}
+
+uint32_t audio_out_remaining(void) {
+  return remaining;
+}
+
+uint32_t audio_out_read_index(void) {
+  return buffer_len - remaining;
+}
+
+int16_t audio_out_transfer(void) {
+  int16_t sample;
+
+  if (buffer_p == NULL) {
+    return 0;
+  }
+
+  sample = buffer_p[buffer_len - remaining];
+  buffer_p[buffer_len - remaining] = 0;
+  --remaining;
+
+  if (remaining == (buffer_len / 2U)) {
+    pending_callback = BSP_AUDIO_OUT_HalfTransfer_CallBack;
+  } else if (remaining == 0) {
+    remaining = buffer_len;
+    pending_callback = BSP_AUDIO_OUT_TransferComplete_CallBack;
+  }
+  audio_out_hold_callbacks(hold_callbacks);
+
+  return sample;
+}
+
+void audio_out_hold_callbacks(uint8_t hold) {
+  void (*callback)(void) = pending_callback;
+
+  hold_callbacks = hold;
+  if (!hold && (callback != NULL)) {
+    pending_callback = NULL;
+    callback();
+  }
+}
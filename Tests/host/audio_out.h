@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the audio output. It keeps the interface of
+   Drivers/BSP/STM32F411E-Discovery/audio_out.h and adds a model of the
+   circular I2S DMA stream that the tests advance one sample at a time */
+
+#ifndef __AUDIO_OUT_H
+#define __AUDIO_OUT_H
+
+#include <stdint.h>
+
+#define AUDIO_OK                 0
+#define AUDIO_ERROR              1
+#define OUTPUT_DEVICE_HEADPHONE  2
+
+uint8_t audio_out_init(uint16_t output_device, uint8_t volume, uint32_t audio_freq);
+uint8_t audio_out_play(int16_t *pbuffer, uint32_t size);
+uint32_t audio_out_remaining(void);
+
+/* Move the DMA on by one 16-bit transfer and return the sample it read.
+   Like the stream's NDTR register, the count of remaining transfers
+   reloads as soon as it reaches zero, and the half and full transfer
+   callbacks run right after the transfer that raises them. Every sample
+   is cleared once it is read, so a half that the player does not render
+   again plays back as silence */
+int16_t audio_out_transfer(void);
+
+/* Hold the half and full transfer callbacks back while hold is set, as
+   when the interrupt has not been taken yet, and run the one that is
+   pending once it is cleared */
+void audio_out_hold_callbacks(uint8_t hold);
+
+/* Index of the sample that the next transfer reads */
+uint32_t audio_out_read_index(void);
+
+/* Called by the DMA as in the BSP */
+void BSP_AUDIO_OUT_HalfTransfer_CallBack(void);
+void BSP_AUDIO_OUT_TransferComplete_CallBack(void);
+
+#endif /* __AUDIO_OUT_H */
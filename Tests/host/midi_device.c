@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "midi_device.h"
+
+
+static uint8_t *rx_data_p = NULL;
+static uint32_t rx_capacity = 0;
+static uint16_t rx_count = 0;
+static uint8_t *tx_data_p = NULL;
+static uint16_t tx_length = 0;
+
+
+USBH_StatusTypeDef usbh_midi_receive(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length) {
+  rx_data_p = pbuff;
+  rx_capacity = length;
+  rx_count = 0;
+
+  return USBH_OK;
+}
+
+uint16_t usbh_midi_last_rx_size(USBH_HandleTypeDef *phost) {
+  return rx_count;
+}
+
+USBH_StatusTypeDef usbh_midi_transmit(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length) {
+  if (tx_length > 0) {
+    return USBH_BUSY;
+  }
+
+  tx_data_p = pbuff;
+  tx_length = (uint16_t)length;
+
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef midi_device_send(USBH_HandleTypeDef *phost, const MIDI_Packet *packets, uint16_t count) {
+  uint32_t length = (uint32_t)count * sizeof(MIDI_Packet);
+
+  if ((rx_data_p == NULL) || (length > rx_capacity)) {
+    return USBH_FAIL;
+  }
+
+  memcpy(rx_data_p, packets, length);
+  rx_count = (uint16_t)length;
+  rx_data_p = NULL;
+  usbh_midi_rx_callback(phost);
+
+  return USBH_OK;
+}
+
+uint16_t midi_device_tx_length(void) {
+  return tx_length;
+}
+
+const uint8_t *midi_device_tx_data(void) {
+  return tx_data_p;
+}
+
+void midi_device_complete_tx(USBH_HandleTypeDef *phost) {
+  if (tx_length > 0) {
+    tx_length = 0;
+    usbh_midi_tx_callback(phost);
+  }
+}
+
+void midi_device_reset(void) {
+  rx_data_p = NULL;
+  rx_count = 0;
+  tx_length = 0;
+}
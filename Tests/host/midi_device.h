@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the USB-MIDI class driver that the player talks
+   to. The test plays the part of the device: it fills the receive
+   buffer that the player armed and completes the transfers that the
+   player started */
+
+#ifndef __MIDI_DEVICE_H
+#define __MIDI_DEVICE_H
+
+#include "usbh_midi.h"
+
+/* Hand a batch of packets to the player as one finished IN transfer.
+   Fails if the player has no receive buffer armed or the batch does
+   not fit in it */
+USBH_StatusTypeDef midi_device_send(USBH_HandleTypeDef *phost, const MIDI_Packet *packets, uint16_t count);
+
+/* Length in bytes of the OUT transfer in flight, 0 when there is none */
+uint16_t midi_device_tx_length(void);
+const uint8_t *midi_device_tx_data(void);
+
+/* Finish the OUT transfer in flight and tell the player */
+void midi_device_complete_tx(USBH_HandleTypeDef *phost);
+
+/* Forget the transfer in flight, as when the device goes away */
+void midi_device_reset(void);
+
+#endif /* __MIDI_DEVICE_H */
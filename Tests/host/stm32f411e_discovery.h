@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the board support header. The model only needs
+   the core registers from it */
+
+#ifndef __STM32F411E_DISCOVERY_H
+#define __STM32F411E_DISCOVERY_H
+
+#include "stm32f4xx.h"
+
+#endif /* __STM32F411E_DISCOVERY_H */
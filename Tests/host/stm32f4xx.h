@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the CMSIS device header. It emulates the packed
+   halfword instructions of the Cortex-M4 bit for bit, so the SIMD32
+   paths of the kernels can be built and checked on a PC, and gives the
+   cycle counter registers something to point at. */
+
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#include <stdint.h>
+
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE static inline
+#endif
+
+#define __weak  __attribute__((weak))
+
+#define __DMB()  __sync_synchronize()
+
+
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+static DWT_Type host_dwt __attribute__((unused));
+static CoreDebug_Type host_core_debug __attribute__((unused));
+
+#define DWT        (&host_dwt)
+#define CoreDebug  (&host_core_debug)
+
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+
+
+__STATIC_INLINE int32_t host_lo(uint32_t x) {
+  return (int16_t)(x & 0xFFFFU);
+}
+
+__STATIC_INLINE int32_t host_hi(uint32_t x) {
+  return (int16_t)(x >> 16);
+}
+
+__STATIC_INLINE uint32_t host_pack(int32_t lo, int32_t hi) {
+  return (uint32_t)(uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+__STATIC_INLINE int32_t __SSAT(int32_t val, uint32_t sat) {
+  int32_t max = (int32_t)((1UL << (sat - 1U)) - 1U);
+
+  if (val > max) {
+    return max;
+  } else if (val < -max - 1) {
+    return -max - 1;
+  }
+  return val;
+}
+
+__STATIC_INLINE uint32_t __QADD16(uint32_t op1, uint32_t op2) {
+  return host_pack(__SSAT(host_lo(op1) + host_lo(op2), 16), __SSAT(host_hi(op1) + host_hi(op2), 16));
+}
+
+__STATIC_INLINE uint32_t __SHADD16(uint32_t op1, uint32_t op2) {
+  return host_pack((host_lo(op1) + host_lo(op2)) >> 1, (host_hi(op1) + host_hi(op2)) >> 1);
+}
+
+__STATIC_INLINE uint32_t __SHSUB16(uint32_t op1, uint32_t op2) {
+  return host_pack((host_lo(op1) - host_lo(op2)) >> 1, (host_hi(op1) - host_hi(op2)) >> 1);
+}
+
+/* The dual multiplies wrap around on overflow like the hardware, which
+   only sets the Q flag */
+__STATIC_INLINE uint32_t __SMUAD(uint32_t op1, uint32_t op2) {
+  return (uint32_t)(host_lo(op1) * host_lo(op2)) + (uint32_t)(host_hi(op1) * host_hi(op2));
+}
+
+__STATIC_INLINE uint32_t __SMUADX(uint32_t op1, uint32_t op2) {
+  return (uint32_t)(host_lo(op1) * host_hi(op2)) + (uint32_t)(host_hi(op1) * host_lo(op2));
+}
+
+__STATIC_INLINE uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3) {
+  return __SMUAD(op1, op2) + op3;
+}
+
+#define __PKHBT(ARG1, ARG2, ARG3) \
+  ((((uint32_t)(ARG1)) & 0x0000FFFFUL) | ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+
+#define __PKHTB(ARG1, ARG2, ARG3) \
+  ((((uint32_t)(ARG1)) & 0xFFFF0000UL) | ((((uint32_t)(ARG2)) >> (ARG3)) & 0x0000FFFFUL))
+
+#endif /* __STM32F4xx_H */
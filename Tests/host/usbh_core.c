@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "usbh_core.h"
+
+#define NUM_OF_PIPES      4U
+#define DEVICE_FIFO_SIZE  65536U
+
+typedef struct {
+  uint8_t ep_addr;
+  uint16_t mps;
+  uint8_t armed;
+  uint8_t halting;
+  uint8_t *buff;
+  uint8_t *halt_buff;
+  uint16_t length;
+  uint32_t xfer_count;
+  USBH_URBStateTypeDef urb_state;
+} SimPipe;
+
+static SimPipe pipes[NUM_OF_PIPES];
+static uint8_t next_pipe = 0;
+static uint8_t device_fifo[DEVICE_FIFO_SIZE];
+static uint32_t device_written = 0;
+static uint32_t device_sent = 0;
+static uint8_t nak_reported = 0;
+
+
+uint8_t USBH_FindInterface(USBH_HandleTypeDef *phost, uint8_t Class, uint8_t SubClass, uint8_t Protocol) {
+  return 0;
+}
+
+USBH_StatusTypeDef USBH_SelectInterface(USBH_HandleTypeDef *phost, uint8_t interface) {
+  return USBH_OK;
+}
+
+uint8_t USBH_AllocPipe(USBH_HandleTypeDef *phost, uint8_t ep_addr) {
+  SimPipe *pipe = &pipes[++next_pipe % NUM_OF_PIPES];
+
+  memset(pipe, 0, sizeof(SimPipe));
+  pipe->ep_addr = ep_addr;
+  return next_pipe % NUM_OF_PIPES;
+}
+
+USBH_StatusTypeDef USBH_FreePipe(USBH_HandleTypeDef *phost, uint8_t idx) {
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num, uint8_t epnum, uint8_t dev_address,
+                                 uint8_t speed, uint8_t ep_type, uint16_t mps) {
+  pipes[pipe_num].mps = mps;
+  return USBH_OK;
+}
+
+/* Closing a pipe halts its channel, like USBH_LL_ClosePipe. The halt
+   only takes effect once the transaction that is on the bus is over,
+   which is in the next frame here (see usbh_core_frame) */
+USBH_StatusTypeDef USBH_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe_num) {
+  SimPipe *pipe = &pipes[pipe_num];
+
+  if (pipe->armed) {
+    pipe->halting = 1;
+    pipe->halt_buff = pipe->buff;
+  }
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_ClrFeature(USBH_HandleTypeDef *phost, uint8_t ep_num) {
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_BulkSendData(USBH_HandleTypeDef *phost, uint8_t *buff, uint16_t length,
+                                     uint8_t pipe_num, uint8_t do_ping) {
+  SimPipe *pipe = &pipes[pipe_num];
+
+  pipe->buff = buff;
+  pipe->length = length;
+  pipe->xfer_count = 0;
+  pipe->urb_state = USBH_URB_IDLE;
+  pipe->armed = 1;
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_BulkReceiveData(USBH_HandleTypeDef *phost, uint8_t *buff, uint16_t length,
+                                        uint8_t pipe_num) {
+  return USBH_BulkSendData(phost, buff, length, pipe_num, 0);
+}
+
+USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t toggle) {
+  return USBH_OK;
+}
+
+USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe) {
+  return pipes[pipe].urb_state;
+}
+
+uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe) {
+  return pipes[pipe].xfer_count;
+}
+
+void usbh_core_device_write(const uint8_t *data, uint32_t length) {
+  uint32_t i;
+
+  for (i = 0; i < length; ++i) {
+    device_fifo[(device_written + i) % DEVICE_FIFO_SIZE] = data[i];
+  }
+  device_written += length;
+}
+
+uint32_t usbh_core_device_sent(void) {
+  return device_sent;
+}
+
+void usbh_core_report_nak(uint8_t report) {
+  nak_reported = report;
+}
+
+void usbh_core_frame(USBH_HandleTypeDef *phost) {
+  SimPipe *pipe;
+  uint32_t length;
+  uint32_t i;
+  uint32_t j;
+
+  for (i = 0; i < NUM_OF_PIPES; ++i) {
+    pipe = &pipes[i];
+    if (!pipe->armed) {
+      continue;
+    }
+
+    if (pipe->halting && ((pipe->ep_addr & 0x80U) != 0) && (device_sent == device_written)) {
+      /* A NAK while the channel is halting. The HAL's NAK handler
+         enables the channel again, so the halt is lost and the read
+         goes on, into whatever transfer was submitted since */
+      pipe->halting = 0;
+    } else if (pipe->halting) {
+      /* The packet that was in flight is ACKed into the buffer of the
+         transfer that was halted. The channel then stops, which also
+         ends any transfer submitted since the halt was asked for */
+      pipe->halting = 0;
+      pipe->buff = pipe->halt_buff;
+      pipe->armed = 0;
+      if ((pipe->ep_addr & 0x80U) == 0) {
+        pipe->xfer_count = pipe->length;
+      } else {
+        length = device_written - device_sent;
+        if (length > pipe->mps) {
+          length = pipe->mps;
+        }
+        for (j = 0; j < length; ++j) {
+          pipe->buff[j] = device_fifo[(device_sent + j) % DEVICE_FIFO_SIZE];
+        }
+        device_sent += length;
+        pipe->xfer_count = length;
+      }
+      pipe->urb_state = USBH_URB_DONE;
+      continue;
+    }
+
+    if ((pipe->ep_addr & 0x80U) == 0) {
+      /* The device takes every OUT packet */
+      pipe->xfer_count = pipe->length;
+      pipe->urb_state = USBH_URB_DONE;
+      pipe->armed = 0;
+    } else if (device_sent == device_written) {
+      /* A NAK, after which the HAL retries the read on its own */
+      if (nak_reported) {
+        pipe->urb_state = USBH_URB_NOTREADY;
+      }
+    } else {
+      length = device_written - device_sent;
+      if (length > pipe->mps) {
+        length = pipe->mps;
+      }
+      if (length > pipe->length) {
+        length = pipe->length;
+      }
+      for (j = 0; j < length; ++j) {
+        pipe->buff[j] = device_fifo[(device_sent + j) % DEVICE_FIFO_SIZE];
+      }
+      device_sent += length;
+      pipe->xfer_count = length;
+      pipe->urb_state = USBH_URB_DONE;
+      pipe->armed = 0;
+    }
+  }
+
+  ++phost->Timer;
+  if ((phost->gState == HOST_CLASS) && (phost->pActiveClass != NULL)) {
+    phost->pActiveClass->SOFProcess(phost);
+  }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the core of the ST USB host library. It holds the
+   types and calls that the MIDI class and the player use, with the
+   same names, so they can be built against a simulated device. Only
+   the parts of the host handle that they touch are kept. usbh_core.c
+   runs the pipes against a simulated bus for the tests of the class
+   driver itself */
+
+#ifndef __USBH_CORE_H
+#define __USBH_CORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f4xx.h"
+
+#define USBH_MAX_NUM_ENDPOINTS   2U
+#define USBH_MAX_NUM_INTERFACES  2U
+
+#define USB_EP_TYPE_BULK         0x02U
+#define HOST_USER_CLASS_ACTIVE   2U
+
+#define USBH_malloc              malloc
+#define USBH_free                free
+#define USBH_DbgLog(...)
+
+typedef enum {
+  USBH_OK = 0,
+  USBH_BUSY,
+  USBH_FAIL,
+  USBH_NOT_SUPPORTED,
+  USBH_UNRECOVERED_ERROR,
+  USBH_ERROR_SPEED_UNKNOWN
+} USBH_StatusTypeDef;
+
+typedef enum {
+  HOST_IDLE = 0,
+  HOST_CLASS = 10
+} HOST_StateTypeDef;
+
+typedef enum {
+  USBH_URB_IDLE = 0,
+  USBH_URB_DONE,
+  USBH_URB_NOTREADY,
+  USBH_URB_NYET,
+  USBH_URB_ERROR,
+  USBH_URB_STALL
+} USBH_URBStateTypeDef;
+
+typedef struct {
+  uint8_t  bEndpointAddress;
+  uint16_t wMaxPacketSize;
+} USBH_EpDescTypeDef;
+
+typedef struct {
+  USBH_EpDescTypeDef Ep_Desc[USBH_MAX_NUM_ENDPOINTS];
+} USBH_InterfaceDescTypeDef;
+
+typedef struct {
+  USBH_InterfaceDescTypeDef Itf_Desc[USBH_MAX_NUM_INTERFACES];
+} USBH_CfgDescTypeDef;
+
+typedef struct {
+  uint8_t             address;
+  uint8_t             speed;
+  USBH_CfgDescTypeDef CfgDesc;
+} USBH_DeviceTypeDef;
+
+struct _USBH_HandleTypeDef;
+
+typedef struct {
+  const char         *Name;
+  uint8_t            ClassCode;
+  USBH_StatusTypeDef (*Init)(struct _USBH_HandleTypeDef *phost);
+  USBH_StatusTypeDef (*DeInit)(struct _USBH_HandleTypeDef *phost);
+  USBH_StatusTypeDef (*Requests)(struct _USBH_HandleTypeDef *phost);
+  USBH_StatusTypeDef (*BgndProcess)(struct _USBH_HandleTypeDef *phost);
+  USBH_StatusTypeDef (*SOFProcess)(struct _USBH_HandleTypeDef *phost);
+  void               *pData;
+} USBH_ClassTypeDef;
+
+/* Timer counts the frames started by the host, like the real handle */
+typedef struct _USBH_HandleTypeDef {
+  volatile HOST_StateTypeDef gState;
+  USBH_DeviceTypeDef         device;
+  USBH_ClassTypeDef          *pActiveClass;
+  volatile uint32_t          Timer;
+  void                       (*pUser)(struct _USBH_HandleTypeDef *phost, uint8_t id);
+} USBH_HandleTypeDef;
+
+uint8_t USBH_FindInterface(USBH_HandleTypeDef *phost, uint8_t Class, uint8_t SubClass, uint8_t Protocol);
+USBH_StatusTypeDef USBH_SelectInterface(USBH_HandleTypeDef *phost, uint8_t interface);
+uint8_t USBH_AllocPipe(USBH_HandleTypeDef *phost, uint8_t ep_addr);
+USBH_StatusTypeDef USBH_FreePipe(USBH_HandleTypeDef *phost, uint8_t idx);
+USBH_StatusTypeDef USBH_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num, uint8_t epnum, uint8_t dev_address,
+                                 uint8_t speed, uint8_t ep_type, uint16_t mps);
+USBH_StatusTypeDef USBH_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe_num);
+USBH_StatusTypeDef USBH_ClrFeature(USBH_HandleTypeDef *phost, uint8_t ep_num);
+USBH_StatusTypeDef USBH_BulkSendData(USBH_HandleTypeDef *phost, uint8_t *buff, uint16_t length,
+                                     uint8_t pipe_num, uint8_t do_ping);
+USBH_StatusTypeDef USBH_BulkReceiveData(USBH_HandleTypeDef *phost, uint8_t *buff, uint16_t length,
+                                        uint8_t pipe_num);
+USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t toggle);
+USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe);
+uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe);
+
+/* Bytes that the device has ready for its IN endpoint. They go out in
+   packets of at most the max packet size, one per frame */
+void usbh_core_device_write(const uint8_t *data, uint32_t length);
+uint32_t usbh_core_device_sent(void);
+
+/* Report a NAK on a read as USBH_URB_NOTREADY, as some versions of the
+   HAL do, instead of retrying it without a word */
+void usbh_core_report_nak(uint8_t report);
+
+/* Run one frame on the bus: every pipe that is armed gets one
+   transaction, then the SOF is counted and handed to the class */
+void usbh_core_frame(USBH_HandleTypeDef *phost);
+
+#endif /* __USBH_CORE_H */
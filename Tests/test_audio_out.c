@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host check of the circular audio DMA. The player runs against a model
+   of the I2S stream whose count of remaining transfers behaves like the
+   NDTR register, while a held chord keeps every period audible. It
+   checks that the half and full transfer callbacks hand over the half
+   the DMA has just left and that the main loop renders every half
+   before the DMA comes back to it. In the second part of the run the
+   main loop stops for up to three periods at a time, and the halves
+   that the DMA plays without a new render must be exactly the ones
+   counted by instrument_player_late_periods(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_player.h"
+#include "midi_device.h"
+
+#define NUM_OF_PERIODS  4000U
+#define STALL_PERIOD    2000U
+#define CHORD_EVERY     64U
+
+static USBH_HandleTypeDef host;
+static uint32_t random_state = 8675309U;
+static long failures;
+
+
+void error_handler(void) {
+  printf("test_audio_out: error_handler called\n");
+  exit(EXIT_FAILURE);
+}
+
+static void fail(const char *what, uint32_t period) {
+  if (failures < 10) {
+    printf("test_audio_out: %s in period %u\n", what, period);
+  }
+  ++failures;
+}
+
+/* Strike a chord of low strings that rings through the next ones */
+static void play_chord(void) {
+  static const MIDI_Packet chord[3] = {
+    { NOTE_ON, 0x90, 28, 127 },
+    { NOTE_ON, 0x90, 35, 127 },
+    { NOTE_ON, 0x90, 40, 127 }
+  };
+
+  if (midi_device_send(&host, chord, 3) != USBH_OK) {
+    error_handler();
+  }
+}
+
+
+int main(void) {
+  uint32_t buffer_len = AUDIO_CHANNELS * AUDIO_BUFFER_SIZE;
+  uint32_t half_len = buffer_len / 2U;
+  uint32_t next_poll = 0;
+  uint32_t stall_end = 0;
+  uint32_t silent_halves = 0;
+  uint32_t late_played = 0;
+  uint32_t late_next = 0;
+  uint32_t sample_count = 0;
+  uint32_t period = 0;
+  uint32_t remaining;
+  uint32_t index;
+  uint8_t heard = 0;
+  int16_t sample;
+
+  instrument_player_init();
+  instrument_player_start_midi(&host);
+
+  while (period < NUM_OF_PERIODS) {
+    if ((sample_count % (CHORD_EVERY * AUDIO_CHANNELS * AUDIO_PERIOD_SIZE)) == 0) {
+      play_chord();
+    }
+
+    /* The main loop checks for a free half at random points, at least
+       twice per period unless it is stalled */
+    if ((sample_count >= next_poll) && (sample_count >= stall_end)) {
+      instrument_player_play();
+      next_poll = sample_count + 1U + dsp_xorshift32(&random_state) % half_len / 2U;
+      if ((period >= STALL_PERIOD) && ((dsp_xorshift32(&random_state) % 32U) == 0)) {
+        stall_end = sample_count + half_len + dsp_xorshift32(&random_state) % (2U * half_len);
+      }
+    }
+
+    sample = audio_out_transfer();
+    heard |= (sample != 0);
+    ++sample_count;
+
+    remaining = audio_out_remaining();
+    if ((remaining == 0) || (remaining > buffer_len)) {
+      fail("remaining transfers out of range", period);
+    }
+
+    index = audio_out_read_index();
+    if ((index % half_len) != 0) {
+      continue;
+    }
+
+    /* The DMA has just left a half, which must now be free to render */
+    if (section_ready != ((index == 0) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF)) {
+      fail("wrong half handed over", period);
+    }
+
+    /* The first two halves play the silence the buffer starts with */
+    if ((period >= 2) && !heard) {
+      if (period < STALL_PERIOD) {
+        fail("half played without a render", period);
+      }
+      ++silent_halves;
+    }
+    heard = 0;
+    ++period;
+
+    /* The callback counts the half that is only starting now */
+    late_played = late_next;
+    late_next = instrument_player_late_periods();
+  }
+
+  if (late_played != silent_halves) {
+    fail("late periods do not match the halves played without a render", period);
+  }
+  if (silent_halves == 0) {
+    fail("main loop never fell behind", period);
+  }
+
+  printf("test_audio_out: %u periods, %u played without a render, %ld failures\n",
+         period, silent_halves, failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
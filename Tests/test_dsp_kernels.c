@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the packed halfword kernels. It is built with the SIMD32
+   paths of instrument_dsp.h switched on and the instructions emulated
+   by host/stm32f4xx.h, and checks every kernel against the portable C
+   that the header falls back to. Random taps, weights and gains are
+   drawn both over the whole 16-bit range and close to zero, where the
+   rounding of the loop filter matters. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_dsp.h"
+
+#if !defined(DSP_SIMD32)
+#error "build the kernel test with -D__ARM_FEATURE_SIMD32=1"
+#endif
+
+#define NUM_OF_ROUNDS  200000L
+#define RUN_LENGTH     67U
+
+static uint32_t random_state = 8675309U;
+static long mismatches;
+
+
+static int16_t random_sample(int small) {
+  uint32_t x = dsp_xorshift32(&random_state);
+
+  return small ? (int16_t)((int32_t)(x % 17U) - 8) : (int16_t)x;
+}
+
+static void random_span(int16_t *dst, uint32_t count) {
+  int small = (dsp_xorshift32(&random_state) & 1U) != 0;
+  uint32_t i;
+
+  for (i = 0; i < count; ++i) {
+    dst[i] = random_sample(small);
+  }
+}
+
+static KsCoeffs random_coeffs(void) {
+  uint16_t frac_coeff = (uint16_t)(dsp_xorshift32(&random_state) % 16385U);
+  uint16_t stretch_coeff = (uint16_t)(dsp_xorshift32(&random_state) % 16385U);
+  uint16_t loss_coeff = (uint16_t)(dsp_xorshift32(&random_state) % 32768U);
+
+  return dsp_ks_coeffs(frac_coeff, stretch_coeff, loss_coeff);
+}
+
+static void check(int16_t expected, int16_t actual, const char *kernel) {
+  if (expected != actual) {
+    if (mismatches < 10) {
+      printf("%s: expected %d, got %d\n", kernel, expected, actual);
+    }
+    ++mismatches;
+  }
+}
+
+
+/* The loop filter on two samples at once and over a run that starts on
+   an odd sample, against the single-sample C filter */
+static void test_ks(void) {
+  int16_t taps[RUN_LENGTH + 3];
+  int16_t out[RUN_LENGTH + 1];
+  KsCoeffs coeffs = random_coeffs();
+  uint32_t pair;
+  uint32_t i;
+
+  random_span(taps, RUN_LENGTH + 3);
+
+  pair = dsp_ks_frac2(taps, coeffs);
+  check(dsp_ks_frac(taps, coeffs), (int16_t)pair, "dsp_ks_frac2");
+  check(dsp_ks_frac(taps + 1, coeffs), (int16_t)(pair >> 16), "dsp_ks_frac2");
+
+  dsp_ks_run(out + 1, taps, RUN_LENGTH, RUN_LENGTH, coeffs);
+  for (i = 0; i < RUN_LENGTH; ++i) {
+    check(dsp_ks_frac(&taps[i], coeffs), out[i + 1], "dsp_ks_run");
+  }
+}
+
+static void test_scale(void) {
+  int16_t src[RUN_LENGTH];
+  int16_t dst[RUN_LENGTH];
+  uint16_t gain = (uint16_t)(dsp_xorshift32(&random_state) % 32768U);
+  uint32_t i;
+
+  random_span(src, RUN_LENGTH);
+  dsp_scale_run(dst, src, RUN_LENGTH, gain);
+  for (i = 0; i < RUN_LENGTH; ++i) {
+    check((int16_t)(((int32_t)src[i] * (int32_t)gain) >> 15), dst[i], "dsp_scale_run");
+  }
+}
+
+static void test_comb(void) {
+  int16_t src[RUN_LENGTH];
+  int16_t delayed[RUN_LENGTH];
+  int16_t dst[RUN_LENGTH];
+  uint16_t gain = (uint16_t)(dsp_xorshift32(&random_state) % 32768U);
+  uint32_t i;
+
+  random_span(src, RUN_LENGTH);
+  random_span(delayed, RUN_LENGTH);
+  dsp_comb_run(dst, src, delayed, RUN_LENGTH, gain);
+  for (i = 0; i < RUN_LENGTH; ++i) {
+    check((int16_t)(((((int32_t)src[i] - (int32_t)delayed[i]) >> 1) * (int32_t)gain) >> 15), dst[i],
+          "dsp_comb_run");
+  }
+}
+
+static void test_mix(void) {
+  int16_t mix[RUN_LENGTH + 1];
+  int16_t expected[RUN_LENGTH + 1];
+  int16_t src[RUN_LENGTH];
+  uint32_t i;
+
+  random_span(mix, RUN_LENGTH + 1);
+  random_span(src, RUN_LENGTH);
+  for (i = 0; i < RUN_LENGTH; ++i) {
+    expected[i + 1] = dsp_mix(mix[i + 1], src[i]);
+  }
+
+  dsp_mix_run(mix + 1, src, RUN_LENGTH);
+  for (i = 0; i < RUN_LENGTH; ++i) {
+    check(expected[i + 1], mix[i + 1], "dsp_mix_run");
+  }
+}
+
+static void test_stereo_expand(void) {
+  int16_t mono[RUN_LENGTH];
+  int16_t out[2 * RUN_LENGTH];
+  uint32_t i;
+
+  random_span(mono, RUN_LENGTH);
+  dsp_stereo_expand(out, mono, RUN_LENGTH);
+  for (i = 0; i < RUN_LENGTH; ++i) {
+    check(mono[i], out[2 * i], "dsp_stereo_expand");
+    check(mono[i], out[2 * i + 1], "dsp_stereo_expand");
+  }
+}
+
+
+int main(void) {
+  long round;
+
+  for (round = 0; round < NUM_OF_ROUNDS; ++round) {
+    test_ks();
+    test_scale();
+    test_comb();
+    test_mix();
+    test_stereo_expand();
+  }
+
+  printf("test_dsp_kernels: %ld rounds, %ld mismatches\n", NUM_OF_ROUNDS, mismatches);
+  return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
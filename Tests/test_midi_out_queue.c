@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the MIDI OUT queue. For one simulated second at a few
+   loads, notes, knob sweeps, data increments and registered parameter
+   changes are queued on four channels. The main loop comes around every
+   5 us, or stalls for 1.5 ms of every 2.9 ms period as if it were
+   rendering, and a bulk OUT transfer takes 12 us plus 0.67 us per
+   byte. The bulk transfers per event are reported for transfers of one
+   packet and of as many as fit in 64 bytes. When nothing was dropped
+   the device has to end up in the state the messages describe, with
+   the notes of each channel in order and every increment counted.
+   After every step each packet that was queued has to be sent,
+   coalesced, dropped, waiting or in flight. A transfer that is still
+   in flight when the queue is cleared counts as dropped. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi_out_queue.h"
+
+#define NUM_OF_CHANNELS  4U
+#define STEP_US          5.0
+#define RUN_US           1e6
+#define RENDER_PERIOD_US 2900.0
+#define RENDER_US        1500.0
+#define MAX_NOTES        200000U
+
+typedef struct {
+  uint8_t control[NUM_OF_CHANNELS][128];
+  uint8_t parameter[NUM_OF_CHANNELS][128];
+  uint32_t increments[NUM_OF_CHANNELS];
+  uint8_t note[NUM_OF_CHANNELS][128];
+} DeviceState;
+
+static MidiOutQueue queue;
+static DeviceState wanted;
+static DeviceState device;
+static uint8_t notes_in[NUM_OF_CHANNELS][MAX_NOTES];
+static uint8_t notes_out[NUM_OF_CHANNELS][MAX_NOTES];
+static uint32_t num_notes_in[NUM_OF_CHANNELS];
+static uint32_t num_notes_out[NUM_OF_CHANNELS];
+static uint32_t random_state = 12345U;
+static uint32_t pushed;
+static uint32_t queued_events;
+static long failures;
+
+
+static void fail(const char *what, double load) {
+  if ((failures < 10) && (load > 0.0)) {
+    printf("test_midi_out_queue: %s (%.0f events/ms)\n", what, load);
+  } else if (failures < 10) {
+    printf("test_midi_out_queue: %s\n", what);
+  }
+  ++failures;
+}
+
+static uint32_t random_next(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/* Apply a message the way a device would. Data entry (6) goes to the
+   registered parameter picked by controllers 101 and 100 */
+static void apply(DeviceState *state, const MIDI_Packet *packet) {
+  uint32_t channel = packet->byte1 & 0xFU;
+
+  if ((packet->byte1 & 0xF0U) == 0xB0U) {
+    if (packet->byte2 == 96U) {
+      ++state->increments[channel];
+    } else if (packet->byte2 == 6U) {
+      state->parameter[channel][state->control[channel][100] & 0x7FU] = packet->byte3;
+    } else {
+      state->control[channel][packet->byte2] = packet->byte3;
+    }
+  } else if ((packet->byte1 & 0xF0U) == 0x90U) {
+    state->note[channel][packet->byte2] = packet->byte3;
+  } else if ((packet->byte1 & 0xF0U) == 0x80U) {
+    state->note[channel][packet->byte2] = 0;
+  }
+}
+
+static void push(const MIDI_Packet *packet) {
+  apply(&wanted, packet);
+  midi_out_queue_push(&queue, packet);
+  ++pushed;
+}
+
+/* Queue one event, which is a note, a turn of a knob, a data increment
+   or the selection and setting of a registered parameter */
+static void queue_event(uint8_t *knobs) {
+  uint32_t x = random_next();
+  uint8_t channel = (uint8_t)(x % NUM_OF_CHANNELS);
+  uint8_t status = (uint8_t)(0xB0U | channel);
+  uint32_t kind = (x >> 4) % 100U;
+  uint8_t note;
+  MIDI_Packet packet;
+
+  ++queued_events;
+  if (kind < 45U) {
+    knobs[channel] = (uint8_t)((knobs[channel] + 1U) & 0x7FU);
+    packet = (MIDI_Packet){0x0B, status, (uint8_t)(1U + ((x >> 12) & 1U)), knobs[channel]};
+    push(&packet);
+  } else if (kind < 50U) {
+    packet = (MIDI_Packet){0x0B, status, 96U, 0};
+    push(&packet);
+  } else if (kind < 55U) {
+    packet = (MIDI_Packet){0x0B, status, 101U, 0};
+    push(&packet);
+    packet = (MIDI_Packet){0x0B, status, 100U, (uint8_t)((x >> 12) & 0x3U)};
+    push(&packet);
+    packet = (MIDI_Packet){0x0B, status, 6U, (uint8_t)((x >> 16) & 0x7FU)};
+    push(&packet);
+  } else {
+    note = (uint8_t)((x >> 12) & 0x7FU);
+    if ((x >> 20) & 1U) {
+      packet = (MIDI_Packet){0x09, (uint8_t)(0x90U | channel), note, 100};
+    } else {
+      packet = (MIDI_Packet){0x08, (uint8_t)(0x80U | channel), note, 0};
+    }
+    if (num_notes_in[channel] < MAX_NOTES) {
+      notes_in[channel][num_notes_in[channel]++] = packet.byte1 ^ packet.byte2;
+    }
+    push(&packet);
+  }
+}
+
+/* The device takes a finished transfer */
+static void receive(const uint8_t *buffer, uint16_t length) {
+  const MIDI_Packet *packet = (const MIDI_Packet*)buffer;
+  uint32_t channel;
+  uint32_t i;
+
+  for (i = 0; i < length / 4U; ++i, ++packet) {
+    apply(&device, packet);
+    if ((packet->byte1 & 0xF0U) != 0xB0U) {
+      channel = packet->byte1 & 0xFU;
+      if (num_notes_out[channel] < MAX_NOTES) {
+        notes_out[channel][num_notes_out[channel]++] = packet->byte1 ^ packet->byte2;
+      }
+    }
+  }
+}
+
+static void check_count(double load) {
+  if (pushed != queue.sent + queue.in_flight + queue.coalesced + queue.dropped + midi_out_queue_depth(&queue)) {
+    fail("packets lost from the count", load);
+  }
+}
+
+static void run(double load, uint8_t render, uint16_t transfer_size) {
+  uint8_t buffer[MIDI_OUT_PACKET_SIZE];
+  uint8_t knobs[NUM_OF_CHANNELS] = {0};
+  uint16_t length = 0;
+  uint32_t transfers = 0;
+  uint32_t channel;
+  double done = -1.0;
+  double events = 0.0;
+  double t;
+
+  memset(&wanted, 0, sizeof(wanted));
+  memset(&device, 0, sizeof(device));
+  memset(num_notes_in, 0, sizeof(num_notes_in));
+  memset(num_notes_out, 0, sizeof(num_notes_out));
+  midi_out_queue_init(&queue);
+  pushed = 0;
+  queued_events = 0;
+
+  for (t = 0.0; (t < RUN_US) || (done >= 0.0) || (midi_out_queue_depth(&queue) > 0); t += STEP_US) {
+    events += (t < RUN_US) ? load * STEP_US / 1000.0 : 0.0;
+    if (render && (t < RUN_US) && (fmod(t, RENDER_PERIOD_US) < RENDER_US)) {
+      continue;
+    }
+    while (events >= 1.0) {
+      events -= 1.0;
+      queue_event(knobs);
+    }
+
+    if ((done >= 0.0) && (t >= done)) {
+      receive(buffer, length);
+      midi_out_queue_complete(&queue);
+      done = -1.0;
+    }
+    if ((done < 0.0) && (midi_out_queue_depth(&queue) > 0)) {
+      length = midi_out_queue_pack(&queue, buffer, transfer_size);
+      done = t + 12.0 + 0.67 * length;
+      ++transfers;
+    }
+    check_count(load);
+  }
+
+  if (queue.dropped == 0) {
+    if (memcmp(&wanted, &device, sizeof(DeviceState)) != 0) {
+      fail("device state differs from the messages", load);
+    }
+    for (channel = 0; channel < NUM_OF_CHANNELS; ++channel) {
+      if ((num_notes_in[channel] != num_notes_out[channel]) ||
+          (memcmp(notes_in[channel], notes_out[channel], num_notes_in[channel]) != 0)) {
+        fail("notes out of order", load);
+      }
+    }
+  }
+
+  printf("  %s %3.0f events/ms, %2u B: %.3f transfers/event, %4.1f%% coalesced, %5u dropped, "
+         "max depth %u\n", render ? "render" : "idle  ", load, transfer_size,
+         (double)transfers / queued_events, 100.0 * queue.coalesced / pushed, queue.dropped, queue.max_depth);
+}
+
+/* Controllers 96 to 101 must never be merged, and a transfer cut off
+   by a disconnect is dropped rather than sent */
+static void check_rules(void) {
+  uint8_t buffer[MIDI_OUT_PACKET_SIZE];
+  MIDI_Packet packet;
+  uint8_t control;
+
+  midi_out_queue_init(&queue);
+  for (control = 96U; control <= 101U; ++control) {
+    packet = (MIDI_Packet){0x0B, 0xB0, control, 1};
+    midi_out_queue_push(&queue, &packet);
+    packet.byte3 = 2;
+    midi_out_queue_push(&queue, &packet);
+  }
+  if ((midi_out_queue_depth(&queue) != 12U) || (queue.coalesced != 0)) {
+    fail("data increment or parameter number coalesced", 0.0);
+  }
+
+  packet = (MIDI_Packet){0x0B, 0xB1, 7, 1};
+  midi_out_queue_push(&queue, &packet);
+  midi_out_queue_push(&queue, &packet);
+  if ((midi_out_queue_depth(&queue) != 13U) || (queue.coalesced != 1U)) {
+    fail("volume not coalesced", 0.0);
+  }
+
+  midi_out_queue_pack(&queue, buffer, 16);
+  midi_out_queue_clear(&queue);
+  if ((queue.sent != 0) || (queue.in_flight != 0) || (queue.dropped != 13U)) {
+    fail("transfer in flight counted as sent after a clear", 0.0);
+  }
+}
+
+
+int main(void) {
+  static const double loads[] = {1.0, 10.0, 50.0, 200.0};
+  uint32_t i;
+
+  uint8_t render;
+
+  printf("test_midi_out_queue:\n");
+  for (render = 0; render < 2; ++render) {
+    for (i = 0; i < sizeof(loads) / sizeof(loads[0]); ++i) {
+      run(loads[i], render, 4U);
+      run(loads[i], render, MIDI_OUT_PACKET_SIZE);
+    }
+  }
+  check_rules();
+
+  printf("test_midi_out_queue: %ld failures\n", failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host stress test of the MIDI event queue. A producer thread pushes
+   numbered events while the consumer pops them on the main thread, with
+   __DMB() as a full barrier. In the first half of the run the producer
+   waits whenever the queue is full, in the second half it drops events
+   like the USB callback does. Every event has to come out whole and in
+   order, and every event pushed has to be either popped or counted as
+   dropped. */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "midi_queue.h"
+
+#define NUM_OF_EVENTS  4000000U
+
+static MidiQueue queue;
+static volatile int producer_done;
+static uint32_t events_pushed;
+
+
+/* The data bytes and the channel are derived from the sequence number,
+   so an event that is torn or stale does not check out */
+static void make_event(MidiEvent *event, uint32_t number) {
+  event->timestamp = number;
+  event->type = (uint8_t)(number >> 14);
+  event->channel = (uint8_t)(number & 0x0FU);
+  event->data1 = (uint8_t)(number & 0x7FU);
+  event->data2 = (uint8_t)((number >> 7) & 0x7FU);
+}
+
+static void *producer(void *arg) {
+  MidiEvent event;
+  uint32_t number = 0;
+
+  while (number < NUM_OF_EVENTS) {
+    if ((number < (NUM_OF_EVENTS / 2U)) && (midi_queue_depth(&queue) >= MIDI_QUEUE_SIZE)) {
+      sched_yield();
+      continue;
+    }
+
+    make_event(&event, number);
+    if (midi_queue_push(&queue, &event) == MIDI_QUEUE_OK) {
+      ++events_pushed;
+    }
+    ++number;
+  }
+
+  producer_done = 1;
+  return NULL;
+}
+
+
+int main(void) {
+  pthread_t thread;
+  MidiEvent event;
+  MidiEvent expected;
+  uint32_t popped = 0;
+  uint32_t bad = 0;
+  uint32_t last = 0;
+
+  midi_queue_init(&queue);
+  if (pthread_create(&thread, NULL, producer, NULL) != 0) {
+    printf("test_midi_queue: cannot start the producer\n");
+    return EXIT_FAILURE;
+  }
+
+  for (;;) {
+    if (midi_queue_pop(&queue, &event) == MIDI_QUEUE_OK) {
+      make_event(&expected, event.timestamp);
+      if (((popped > 0) && (event.timestamp <= last)) || (event.type != expected.type) ||
+          (event.channel != expected.channel) || (event.data1 != expected.data1) ||
+          (event.data2 != expected.data2)) {
+        ++bad;
+      }
+      last = event.timestamp;
+      ++popped;
+    } else if (producer_done && (midi_queue_depth(&queue) == 0)) {
+      break;
+    } else {
+      sched_yield();
+    }
+  }
+  pthread_join(thread, NULL);
+
+  printf("test_midi_queue: %u events, %u popped, %u dropped, %u bad, max depth %u\n",
+         NUM_OF_EVENTS, popped, queue.dropped, bad, queue.max_depth);
+
+  return ((bad == 0) && (popped == events_pushed) && (popped + queue.dropped == NUM_OF_EVENTS) &&
+          (popped >= (NUM_OF_EVENTS / 2U)) && (queue.max_depth <= MIDI_QUEUE_SIZE)) ?
+         EXIT_SUCCESS : EXIT_FAILURE;
+}
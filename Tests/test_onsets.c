@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the note onsets. The player runs against the model of
+   the audio DMA and a key is struck while the instrument is silent,
+   at a different point of the period each time. The note has to start
+   exactly one buffer (two periods) after the frame the DMA was reading
+   when the packet arrived, however late in the period the main loop
+   gets around to rendering it. Some keys arrive on the first frame of
+   a period while the DMA has already moved into it but its half or
+   full transfer interrupt has not run yet. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_player.h"
+#include "midi_device.h"
+
+#define NUM_OF_ONSETS  40U
+#define NOTE           57U
+
+/* Time for a released note to die out and its voice to be freed */
+#define SILENCE_SAMPLES  (AUDIO_CHANNELS * SAMPLE_FREQUENCY)
+
+static USBH_HandleTypeDef host;
+static uint32_t random_state = 8675309U;
+static uint32_t sample_count = 0;
+static uint32_t next_poll = 0;
+static int16_t last_frame[AUDIO_CHANNELS];
+static long failures;
+
+
+void error_handler(void) {
+  printf("test_onsets: error_handler called\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Let the DMA read one sample, with the main loop checking for a free
+   half at random points at least twice per period */
+static int16_t play_sample(void) {
+  uint32_t half_len = AUDIO_CHANNELS * AUDIO_PERIOD_SIZE;
+
+  if (sample_count >= next_poll) {
+    instrument_player_play();
+    next_poll = sample_count + 1U + dsp_xorshift32(&random_state) % half_len / 2U;
+  }
+  ++sample_count;
+
+  return audio_out_transfer();
+}
+
+/* Let the DMA read the rest of the current frame. Returns whether the
+   frame was silent */
+static int play_frame(void) {
+  do {
+    last_frame[sample_count % AUDIO_CHANNELS] = play_sample();
+  } while ((sample_count % AUDIO_CHANNELS) != 0);
+
+  return (last_frame[0] == 0) && (last_frame[1] == 0);
+}
+
+static void send_key(uint8_t status, uint8_t velocity) {
+  MIDI_Packet packet = { (uint8_t)(status >> 4), status, NOTE, velocity };
+
+  if (midi_device_send(&host, &packet, 1) != USBH_OK) {
+    error_handler();
+  }
+}
+
+/* Offset into the period at which the key of an onset arrives. The
+   edges of the period are tried first */
+static uint32_t arrival_offset(uint32_t onset) {
+  static const uint32_t edges[] = { 0, 1, AUDIO_PERIOD_SIZE - 1U, AUDIO_PERIOD_SIZE / 2U };
+
+  if (onset < (sizeof(edges) / sizeof(edges[0]))) {
+    return edges[onset];
+  }
+  return dsp_xorshift32(&random_state) % AUDIO_PERIOD_SIZE;
+}
+
+
+int main(void) {
+  uint8_t late_interrupt;
+  uint32_t arrival;
+  uint32_t frame;
+  uint32_t onset;
+  uint32_t i;
+
+  instrument_player_init();
+  instrument_player_start_midi(&host);
+
+  for (onset = 0; onset < NUM_OF_ONSETS; ++onset) {
+    /* Wait for silence, then for the frame the key arrives on. Every
+       other key arrives between the two samples of the frame */
+    for (i = 0; i < SILENCE_SAMPLES; i += AUDIO_CHANNELS) {
+      if (!play_frame()) {
+        i = 0;
+      }
+    }
+    late_interrupt = (onset >= 4U) && ((onset % 4U) == 2U);
+    frame = sample_count / AUDIO_CHANNELS;
+    arrival = frame + (AUDIO_PERIOD_SIZE - frame % AUDIO_PERIOD_SIZE);
+    if (!late_interrupt) {
+      arrival += arrival_offset(onset);
+    }
+    while (sample_count / AUDIO_CHANNELS < arrival) {
+      audio_out_hold_callbacks(late_interrupt && ((sample_count / AUDIO_CHANNELS + 1U) == arrival));
+      play_frame();
+    }
+    if ((onset & 1U) != 0) {
+      last_frame[0] = play_sample();
+    }
+
+    send_key(0x90, 127);
+    audio_out_hold_callbacks(0);
+    if (((onset & 1U) != 0) && (last_frame[0] != 0)) {
+      printf("test_onsets: key at frame %u sounded at once\n", arrival);
+      ++failures;
+    }
+    while (play_frame()) {
+    }
+    frame = (sample_count - 1U) / AUDIO_CHANNELS;
+
+    if (frame != (arrival + AUDIO_BUFFER_SIZE)) {
+      if (failures < 10) {
+        printf("test_onsets: key at frame %u started at frame %u instead of %u\n",
+               arrival, frame, arrival + AUDIO_BUFFER_SIZE);
+      }
+      ++failures;
+    }
+    if (last_frame[0] != last_frame[1]) {
+      printf("test_onsets: channels differ at frame %u\n", frame);
+      ++failures;
+    }
+
+    send_key(0x80, 0);
+  }
+
+  printf("test_onsets: %u onsets, %ld late or early\n", NUM_OF_ONSETS, failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the pitch wheel. Every key is played and the wheel is
+   moved from the top to the bottom while it is rendered, stopping on
+   every step of the bend table and halfway between two steps. After
+   each move the period of the voice's loop, worked out in double
+   precision from its delay and the phase delays of its loop filter,
+   has to be the period of the unbent note bent by the position of the
+   wheel over PITCH_BEND_RANGE semitones. While the burst is still
+   being copied the newest tap may not have passed it, and the copy may
+   only jump ahead as far as the new delay needs. Lifting the sustain
+   pedal has to leave the bend alone. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+
+#define MAX_CENTS          0.05
+
+static InstrumentModel model;
+static long failures;
+
+
+static void fail(const char *what, uint32_t note, uint32_t step) {
+  if (failures < 10) {
+    printf("test_pitch_bend: %s (note %u, step %u)\n", what, note, step);
+  }
+  ++failures;
+}
+
+/* Phase delay in samples of the two-tap filter (1 - a) + a z^-1 at omega */
+static double phase_delay(double a, double omega) {
+  return atan2(a * sin(omega), 1.0 - a + a * cos(omega)) / omega;
+}
+
+/* Period of a loop with the given delay and filter coefficients */
+static double loop_period(uint32_t delay, uint32_t frac_coeff, uint32_t stretch_coeff) {
+  double period = delay;
+  uint32_t pass;
+
+  for (pass = 0; pass < 20; ++pass) {
+    period = delay + phase_delay(stretch_coeff / 32768.0, 2.0 * M_PI / period) +
+             phase_delay(frac_coeff / 16384.0, 2.0 * M_PI / period);
+  }
+  return period;
+}
+
+static void render(uint32_t section) {
+  section_ready = (section & 1U) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+  instrument_model_begin(&model);
+  instrument_model_end(&model);
+}
+
+
+int main(void) {
+  InstrumentVoice *voice = &model.voices[0];
+  uint32_t section = 0;
+  uint32_t checked = 0;
+  uint32_t note_index;
+  uint32_t burst_left;
+  uint32_t expected;
+  uint16_t position = BEND_CENTER;
+  uint32_t step;
+  uint32_t lag;
+  double worst = 0.0;
+  double target;
+  double cents;
+
+  for (note_index = 0; note_index < NUM_OF_NOTES; ++note_index) {
+    instrument_model_init(&model);
+    instrument_model_note_on(&model, (uint8_t)(MIDI_NOTE_OFFSET - note_index), 100,
+                             note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                             note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                             note_bend_delays[note_index]);
+
+    for (step = 0; step <= 2U * BEND_STEPS; ++step) {
+      position = (uint16_t)((step == 0) ? BEND_MAX : (BEND_MAX + 1U - step * 64U));
+      lag = (voice->memory.rw_index - voice->burst_index) & (voice->memory.mem_len - 1);
+      burst_left = voice->burst_left;
+
+      instrument_model_bend(&model, position);
+      render(section++);
+
+      /* The highest keys die out before the wheel is all the way down */
+      if (!voice->active) {
+        break;
+      }
+
+      /* The render copies one period of the burst after the retune */
+      expected = 0;
+      if ((burst_left > 0) && (voice->max_delay < lag)) {
+        burst_left -= (lag - voice->max_delay < burst_left) ? (lag - voice->max_delay) : burst_left;
+      }
+      if (burst_left > AUDIO_PERIOD_SIZE) {
+        expected = burst_left - AUDIO_PERIOD_SIZE;
+      }
+      if (voice->burst_left != expected) {
+        fail("burst copied further than the delay needs", MIDI_NOTE_OFFSET - note_index, step);
+      }
+      lag = (voice->memory.rw_index - voice->burst_index) & (voice->memory.mem_len - 1);
+      if ((voice->burst_left > 0) && (lag > voice->max_delay)) {
+        fail("newest tap ahead of the copied burst", MIDI_NOTE_OFFSET - note_index, step);
+      }
+
+      ++checked;
+      target = loop_period(note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                           note_stretch_coeffs[note_index]) *
+               pow(2.0, -PITCH_BEND_RANGE * ((double)position - BEND_CENTER) / BEND_CENTER / 12.0);
+      cents = 1200.0 * log2(loop_period(voice->max_delay, voice->frac_coeff, voice->stretch_coeff) / target);
+      if (fabs(cents) > worst) {
+        worst = fabs(cents);
+      }
+      if (fabs(cents) > MAX_CENTS) {
+        fail("bent period out of tune", MIDI_NOTE_OFFSET - note_index, step);
+      }
+    }
+
+    instrument_model_sustain(&model, 1);
+    instrument_model_sustain(&model, 0);
+    if (model.bend != position) {
+      fail("sustain pedal reset the bend", MIDI_NOTE_OFFSET - note_index, step);
+    }
+  }
+
+  printf("test_pitch_bend: %u keys, %u bent periods, worst %.4f cents, %ld failures\n",
+         NUM_OF_NOTES, checked, worst, failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the sustain pedal. For 40000 periods keys in the middle
+   of the keyboard are pressed and released at random while the pedal
+   goes up and down often. After every period a voice may only be in
+   sustained_voices while the pedal is down, its key is up and it is
+   still ringing undamped, and a voice whose key is up has to be either
+   in the mask or damped. Lifting the pedal has to empty the mask. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+
+#define NUM_OF_SECTIONS  40000U
+#define LOWEST_NOTE      48U
+#define NUM_OF_KEYS      24U
+
+static InstrumentModel model;
+static uint32_t random_state = 2463534242U;
+static uint8_t key_down[128];
+static uint8_t pedal_down = 0;
+static long failures;
+
+
+static void fail(const char *what, uint32_t section, uint32_t voice) {
+  if (failures < 10) {
+    printf("test_sustain: %s (voice %u, section %u)\n", what, voice, section);
+  }
+  ++failures;
+}
+
+static void random_event(uint32_t section) {
+  uint32_t x = dsp_xorshift32(&random_state);
+  uint8_t note = (uint8_t)(LOWEST_NOTE + (x >> 8) % NUM_OF_KEYS);
+  uint32_t note_index = MIDI_NOTE_OFFSET - note;
+
+  if (((x >> 16) & 0xFU) == 0) {
+    pedal_down = !pedal_down;
+    instrument_model_sustain(&model, pedal_down);
+    if (!pedal_down && (model.sustained_voices != 0)) {
+      fail("pedal lifted with voices still held", section, 0);
+    }
+  } else if (!key_down[note]) {
+    instrument_model_note_on(&model, note, (uint8_t)((x >> 20) & 0x7FU), note_delay_lengths[note_index],
+                             note_frac_coeffs[note_index], note_stretch_coeffs[note_index],
+                             note_loss_coeffs[note_index], note_bend_delays[note_index]);
+    key_down[note] = 1;
+  } else {
+    instrument_model_note_off(&model, note, note_release_coeffs[note_index]);
+    key_down[note] = 0;
+  }
+}
+
+
+int main(void) {
+  InstrumentVoice *voice;
+  uint32_t max_sustained = 0;
+  uint32_t sustained;
+  uint32_t section;
+  uint32_t held;
+  uint32_t i;
+
+  instrument_model_init(&model);
+
+  for (section = 0; section < NUM_OF_SECTIONS; ++section) {
+    section_ready = (section & 1U) ? BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+    instrument_model_begin(&model);
+    for (i = 0; i < 2; ++i) {
+      if ((dsp_xorshift32(&random_state) & 0x3U) == 0) {
+        random_event(section);
+      }
+    }
+    instrument_model_end(&model);
+
+    sustained = 0;
+    for (i = 0; i < MAX_VOICES; ++i) {
+      voice = &model.voices[i];
+      held = (model.sustained_voices >> i) & 1U;
+      sustained += held;
+
+      if (held && (!voice->active || voice->released || key_down[voice->note] || !pedal_down)) {
+        fail("voice held by the pedal that should not be", section, i);
+      }
+      if (voice->active && !voice->released && !key_down[voice->note] && !held) {
+        fail("voice of a released key neither held nor damped", section, i);
+      }
+    }
+    if (sustained > max_sustained) {
+      max_sustained = sustained;
+    }
+  }
+
+  if (max_sustained == 0) {
+    fail("pedal never held a voice", section, 0);
+  }
+
+  printf("test_sustain: %u periods, up to %u voices held by the pedal, %ld failures\n",
+         NUM_OF_SECTIONS, max_sustained, failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
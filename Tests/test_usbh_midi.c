@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the receive side of the USB-MIDI class driver. The
+   driver runs against simulated pipes while a device sends bursts of
+   packets at random, often exactly a full USB packet and then nothing.
+   Every byte has to come out of the receive callback once and in
+   order. A batch can take a full packet per frame until the buffer is
+   full, but no byte may wait longer than the frames that fill it, even
+   when the read that follows a full packet is only ever NAKed. The run
+   is made once with the NAKs hidden, as the HAL in this tree does, and
+   once with them reported as USBH_URB_NOTREADY. The simulated pipes
+   halt a frame late, the way the channels do, so a driver that halts
+   the read to hand over a batch loses the packet still in flight.
+
+   The throughput is reported in 4-byte events per millisecond (one
+   frame), both for the random traffic and for a backlog that keeps the
+   IN pipe busy, which has to take a full packet every frame. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usbh_midi.h"
+
+#define NUM_OF_FRAMES     200000U
+#define EP_SIZE           64U
+#define RX_BUFFER_SIZE    256U
+#define MAX_WAIT_FRAMES   (RX_BUFFER_SIZE / EP_SIZE)
+#define BACKLOG_EVENTS    4000U
+
+static USBH_HandleTypeDef host;
+static uint8_t rx_buffers[2][RX_BUFFER_SIZE];
+static uint8_t rx_buffer = 0;
+static uint8_t stream[NUM_OF_FRAMES * 32U];
+static uint32_t written = 0;
+static uint32_t received = 0;
+static uint32_t batches = 0;
+static uint32_t nak_batches = 0;
+static uint32_t frames = 0;
+static uint32_t random_state = 88172645U;
+static long failures;
+
+
+static void fail(const char *what, uint32_t frame) {
+  if (failures < 10) {
+    printf("test_usbh_midi: %s (frame %u)\n", what, frame);
+  }
+  ++failures;
+}
+
+static uint32_t random_next(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+void usbh_midi_rx_callback(USBH_HandleTypeDef *phost) {
+  uint16_t length = usbh_midi_last_rx_size(phost);
+
+  if (memcmp(&rx_buffers[rx_buffer][0], &stream[received], length) != 0) {
+    fail("batch does not match the stream", phost->Timer);
+  }
+  received += length;
+  ++batches;
+  if (((length % EP_SIZE) == 0) && (length < RX_BUFFER_SIZE)) {
+    ++nak_batches;
+  }
+
+  rx_buffer ^= 1U;
+  usbh_midi_receive(phost, &rx_buffers[rx_buffer][0], RX_BUFFER_SIZE);
+}
+
+/* Let the device have a number of packets, often exactly as many as
+   fill a USB packet or two */
+static void device_write(void) {
+  uint32_t x = random_next();
+  uint32_t count;
+  uint32_t i;
+
+  if ((x & 0x3U) != 0) {
+    return;
+  }
+  count = ((x >> 2) & 1U) ? (EP_SIZE / 4U) * (1U + ((x >> 3) & 1U)) : 1U + ((x >> 4) % 24U);
+  for (i = 0; i < count * 4U; ++i) {
+    stream[written + i] = (uint8_t)random_next();
+  }
+  usbh_core_device_write(&stream[written], count * 4U);
+  written += count * 4U;
+}
+
+static void run(uint8_t report_nak) {
+  uint32_t sent_at[MAX_WAIT_FRAMES + 1];
+  uint32_t frame;
+  uint32_t i;
+
+  memset(sent_at, 0, sizeof(sent_at));
+  usbh_core_report_nak(report_nak);
+
+  for (frame = 0; frame < NUM_OF_FRAMES / 2; ++frame) {
+    device_write();
+
+    /* The main loop gets around more than once a frame */
+    for (i = 0; i < 3; ++i) {
+      host.pActiveClass->BgndProcess(&host);
+    }
+    usbh_core_frame(&host);
+
+    for (i = 0; i < MAX_WAIT_FRAMES; ++i) {
+      sent_at[i] = sent_at[i + 1];
+    }
+    sent_at[MAX_WAIT_FRAMES] = usbh_core_device_sent();
+    if (received < sent_at[0]) {
+      fail("bytes held back after they crossed the bus", frame);
+    }
+  }
+  frames += NUM_OF_FRAMES / 2;
+}
+
+/* Give the device a backlog and count the frames until it has all
+   crossed the bus. The last batch comes out of the receive callback a
+   frame or two later, once the read that follows it is NAKed */
+static uint32_t drain_backlog(void) {
+  uint32_t sent_frames = 0;
+  uint32_t frame;
+  uint32_t i;
+
+  for (i = 0; i < BACKLOG_EVENTS * 4U; ++i) {
+    stream[written + i] = (uint8_t)random_next();
+  }
+  usbh_core_device_write(&stream[written], BACKLOG_EVENTS * 4U);
+  written += BACKLOG_EVENTS * 4U;
+
+  for (frame = 0; (received < written) && (frame < BACKLOG_EVENTS); ++frame) {
+    for (i = 0; i < 3; ++i) {
+      host.pActiveClass->BgndProcess(&host);
+    }
+    usbh_core_frame(&host);
+    if ((sent_frames == 0) && (usbh_core_device_sent() == written)) {
+      sent_frames = frame + 1U;
+    }
+  }
+  if (received != written) {
+    fail("backlog not handed over", frame);
+  }
+  return sent_frames;
+}
+
+
+int main(void) {
+  static USBH_ClassTypeDef active_class;
+  uint32_t backlog_frames;
+
+  active_class = midi_class;
+  host.pActiveClass = &active_class;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[0].bEndpointAddress = 0x81U;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[0].wMaxPacketSize = EP_SIZE;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[1].bEndpointAddress = 0x01U;
+  host.device.CfgDesc.Itf_Desc[0].Ep_Desc[1].wMaxPacketSize = EP_SIZE;
+  host.pActiveClass->Init(&host);
+  host.gState = HOST_CLASS;
+
+  usbh_midi_receive(&host, &rx_buffers[0][0], RX_BUFFER_SIZE);
+  run(0);
+  run(1);
+  backlog_frames = drain_backlog();
+
+  if (nak_batches == 0) {
+    fail("no batch ended on a full packet", 0);
+  }
+  if (received > usbh_core_device_sent()) {
+    fail("more bytes received than sent", 0);
+  }
+  /* The last frame may only be partly used */
+  if (backlog_frames > (BACKLOG_EVENTS / (EP_SIZE / 4U) + 1U)) {
+    fail("backlog not received at a full packet per frame", backlog_frames);
+  }
+
+  printf("test_usbh_midi: %u bytes in %u batches, %u ended by a NAK or timeout\n",
+         received, batches, nak_batches);
+  printf("  %.2f events/ms of random traffic, %.2f events/ms from a backlog\n",
+         (received - BACKLOG_EVENTS * 4U) / 4.0 / frames, (double)BACKLOG_EVENTS / backlog_frames);
+  printf("test_usbh_midi: %ld failures\n", failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
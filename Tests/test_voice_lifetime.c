@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host test of how voices are freed. Random keys are played, held and
+   released, some of them under the sustain pedal, and every time a
+   voice is freed the part of its delay line that feeds the loop has to
+   be below the voice's threshold. Otherwise a louder stretch would come
+   around again after the voice went quiet for a moment, and would leak
+   into the next note that gets the voice. Released voices also have to
+   be freed within a second, and a held note on the highest key once it
+   has died out on its own. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_model.h"
+#include "delay_lengths.h"
+
+#define NUM_OF_SECTIONS    40000U
+#define SECTIONS_PER_SEC   (SAMPLE_FREQUENCY / AUDIO_PERIOD_SIZE)
+
+static InstrumentModel model;
+static uint32_t random_state = 8675309U;
+static uint32_t released_at[MAX_VOICES];
+static long failures;
+
+
+static void fail(const char *what, uint32_t section, uint32_t voice) {
+  if (failures < 10) {
+    printf("test_voice_lifetime: %s (voice %u, section %u)\n", what, voice, section);
+  }
+  ++failures;
+}
+
+static void process(void) {
+  section_ready = (section_ready == BUFFER_SECTION_FIRST_HALF) ?
+                  BUFFER_SECTION_SECOND_HALF : BUFFER_SECTION_FIRST_HALF;
+  instrument_model_process(&model);
+}
+
+/* The loop reads the D + 2 samples before the write index */
+static int loop_is_quiet(const InstrumentVoice *voice, int32_t level) {
+  uint32_t mask = voice->memory.mem_len - 1U;
+  uint32_t index = voice->memory.rw_index;
+  uint32_t i;
+  int16_t sample;
+
+  for (i = 0; i < (uint32_t)voice->max_delay + 2U; ++i) {
+    index = (index - 1U) & mask;
+    sample = voice->memory.mem_p[index];
+    if ((sample >= level) || (sample <= -level)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void random_event(void) {
+  uint32_t x = dsp_xorshift32(&random_state);
+  uint32_t note_index = (x >> 8) % NUM_OF_NOTES;
+  uint8_t note = (uint8_t)(MIDI_NOTE_OFFSET - note_index);
+
+  switch (x & 0x7U) {
+    case 0:
+    case 1:
+    case 2:
+      instrument_model_note_on(&model, note, (uint8_t)(1U + (x >> 16) % 127U),
+                               note_delay_lengths[note_index], note_frac_coeffs[note_index],
+                               note_stretch_coeffs[note_index], note_loss_coeffs[note_index],
+                               note_bend_delays[note_index]);
+      break;
+    case 3:
+    case 4:
+    case 5:
+      instrument_model_note_off(&model, note, note_release_coeffs[note_index]);
+      break;
+    default:
+      instrument_model_sustain(&model, (x >> 16) & 1U);
+      break;
+  }
+}
+
+
+int main(void) {
+  uint8_t was_active[MAX_VOICES];
+  InstrumentVoice *voice;
+  uint32_t section;
+  uint32_t freed = 0;
+  uint32_t i;
+
+  instrument_model_init(&model);
+
+  for (section = 0; section < NUM_OF_SECTIONS; ++section) {
+    /* Play for the first half of the run and let everything ring out
+       in the second half */
+    if ((section < (NUM_OF_SECTIONS / 2U)) && ((dsp_xorshift32(&random_state) % 4U) == 0)) {
+      random_event();
+    } else if (section == (NUM_OF_SECTIONS / 2U)) {
+      instrument_model_sustain(&model, 0);
+    }
+
+    for (i = 0; i < MAX_VOICES; ++i) {
+      voice = &model.voices[i];
+      was_active[i] = voice->active;
+      if (!voice->active || !voice->released) {
+        released_at[i] = section;
+      }
+    }
+
+    process();
+
+    for (i = 0; i < MAX_VOICES; ++i) {
+      voice = &model.voices[i];
+      if (voice->active) {
+        if (voice->released && ((section - released_at[i]) > SECTIONS_PER_SEC)) {
+          fail("released voice still active after a second", section, i);
+          released_at[i] = section;
+        }
+      } else if (was_active[i]) {
+        ++freed;
+        if (!loop_is_quiet(voice, voice->released ? RELEASE_THRESHOLD : SILENCE_THRESHOLD)) {
+          fail("voice freed with a loud delay line", section, i);
+        }
+      }
+    }
+  }
+
+  /* A held note on the highest key dies out on its own within a few
+     times its decay time */
+  instrument_model_init(&model);
+  instrument_model_note_on(&model, MIDI_NOTE_OFFSET, 127, note_delay_lengths[0], note_frac_coeffs[0],
+                           note_stretch_coeffs[0], note_loss_coeffs[0], note_bend_delays[0]);
+  for (section = 0; model.voices[0].active && (section < 10U * SECTIONS_PER_SEC); ++section) {
+    process();
+  }
+  if (model.voices[0].active || !model.voices[0].idle) {
+    fail("held note never went idle", section, 0);
+  } else if (!loop_is_quiet(&model.voices[0], SILENCE_THRESHOLD)) {
+    fail("held note went idle with a loud delay line", section, 0);
+  }
+
+  for (i = 0; i < MAX_VOICES; ++i) {
+    if (model.voices[i].active) {
+      fail("voice left active", section, i);
+    }
+  }
+
+  printf("test_voice_lifetime: %u voices freed, highest key idle after %u periods, %ld failures\n",
+         freed, section, failures);
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
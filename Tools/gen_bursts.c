@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host program that generates the bank of excitation bursts that the
+   Karplus-Strong model copies into a voice's delay line at note-on.
+   It is run by the Makefile before the firmware is compiled:
+
+     gen_bursts <variants> <layers> <length> <seed> <headroom dB>
+
+   and writes excitation_bursts.h to stdout. Every burst is checked
+   before the header is written and the program fails if one of them
+   is out of range. The header also holds the velocity curve that
+   picks the gain and the brightness layer of a burst. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "instrument_dsp.h"
+
+/* Largest bank that is allowed into the 512K of flash */
+#define FLASH_BUDGET  (256L * 1024L)
+
+#define NUM_OF_VELOCITIES  128
+
+
+/* Smooth a burst with a number of passes of the two-tap average that
+   is also used in the feedback loop. Every pass halves the level at
+   the top of the spectrum */
+static void lowpass(double *burst, long length, int passes) {
+  double prev;
+  double curr;
+  long i;
+
+  while (passes--) {
+    prev = 0.0;
+    for (i = 0; i < length; ++i) {
+      curr = burst[i];
+      burst[i] = 0.5 * (curr + prev);
+      prev = curr;
+    }
+  }
+}
+
+/* Remove the DC offset and scale a burst to full range */
+static void normalize(const double *burst, long *out, long length) {
+  double mean = 0.0;
+  double peak = 0.0;
+  long i;
+
+  for (i = 0; i < length; ++i) {
+    mean += burst[i];
+  }
+  mean /= (double)length;
+
+  for (i = 0; i < length; ++i) {
+    if (fabs(burst[i] - mean) > peak) {
+      peak = fabs(burst[i] - mean);
+    }
+  }
+
+  for (i = 0; i < length; ++i) {
+    out[i] = lround((burst[i] - mean) * 32767.0 / peak);
+  }
+}
+
+/* Ratio of the energy of the first difference to the energy of the
+   burst. It grows with the brightness of the burst */
+static double brightness(const long *burst, long length) {
+  double energy = 0.0;
+  double diff_energy = 0.0;
+  long i;
+
+  for (i = 1; i < length; ++i) {
+    energy += (double)burst[i] * (double)burst[i];
+    diff_energy += (double)(burst[i] - burst[i - 1]) * (double)(burst[i] - burst[i - 1]);
+  }
+
+  return diff_energy / energy;
+}
+
+/* Check that a burst fits into 16 bits and has no DC offset */
+static int check_burst(const long *burst, long length) {
+  double mean = 0.0;
+  long i;
+
+  for (i = 0; i < length; ++i) {
+    if ((burst[i] > 32767) || (burst[i] < -32767)) {
+      return 0;
+    }
+    mean += (double)burst[i];
+  }
+
+  return fabs(mean / (double)length) < 1.0;
+}
+
+static void print_curve(const char *type, const char *name, const long *values) {
+  int i;
+
+  printf("static const %s %s[%d] = {\n", type, name, NUM_OF_VELOCITIES);
+  for (i = 0; i < NUM_OF_VELOCITIES; ++i) {
+    if ((i % 8) == 0) {
+      printf("  ");
+    }
+    printf("%ld%s", values[i], (i == NUM_OF_VELOCITIES - 1) ? "\n" : (((i % 8) == 7) ? ",\n" : ", "));
+  }
+  printf("};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+  int16_t *noise;
+  double *burst;
+  long *bank;
+  long *out;
+  long variants;
+  long layers;
+  long length;
+  uint32_t seed;
+  uint32_t state;
+  double headroom;
+  long gains[NUM_OF_VELOCITIES];
+  long layer_map[NUM_OF_VELOCITIES];
+  double last;
+  double curr;
+  long v;
+  long l;
+  long i;
+
+  if (argc != 6) {
+    fprintf(stderr, "usage: %s <variants> <layers> <length> <seed> <headroom dB>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  variants = atol(argv[1]);
+  layers = atol(argv[2]);
+  length = atol(argv[3]);
+  seed = (uint32_t)strtoul(argv[4], NULL, 0);
+  headroom = atof(argv[5]);
+
+  if ((variants < 1) || (layers < 1) || (length < 2) || (seed == 0) || (headroom < 0.0) ||
+      ((variants & (variants - 1)) != 0)) {
+    fprintf(stderr, "variants must be a power of 2, layers and length positive, seed non-zero "
+            "and headroom not negative\n");
+    return EXIT_FAILURE;
+  }
+  if (variants * layers * length * (long)sizeof(int16_t) > FLASH_BUDGET) {
+    fprintf(stderr, "bank needs %ld bytes of flash, budget is %ld\n",
+            variants * layers * length * (long)sizeof(int16_t), FLASH_BUDGET);
+    return EXIT_FAILURE;
+  }
+
+  noise = malloc(length * sizeof(int16_t));
+  burst = malloc(length * sizeof(double));
+  bank = malloc(variants * layers * length * sizeof(long));
+  if ((noise == NULL) || (burst == NULL) || (bank == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (v = 0; v < variants; ++v) {
+    /* Same generator as the firmware so the bank is the same on
+       every host */
+    state = seed + (uint32_t)v * 0x9E3779B9U;
+    if (state == 0) {
+      state = seed;
+    }
+    dsp_noise_run(noise, length, &state);
+
+    /* The top layer is the raw noise and every layer below it is
+       darker than the one above */
+    last = 0.0;
+    for (l = 0; l < layers; ++l) {
+      out = &bank[(v * layers + l) * length];
+      for (i = 0; i < length; ++i) {
+        burst[i] = (double)noise[i];
+      }
+      lowpass(burst, length, 2 * (int)(layers - 1 - l));
+      normalize(burst, out, length);
+
+      curr = brightness(out, length);
+      if (!check_burst(out, length) || ((l > 0) && (curr <= last))) {
+        fprintf(stderr, "burst %ld of layer %ld failed the checks\n", v, l);
+        return EXIT_FAILURE;
+      }
+      last = curr;
+    }
+  }
+
+  /* The level of a note follows the square of the velocity, below a
+     fixed headroom that leaves room for chords in the mix. The layers
+     are spread evenly over the velocity range */
+  for (i = 0; i < NUM_OF_VELOCITIES; ++i) {
+    gains[i] = lround(32767.0 * pow(10.0, -headroom / 20.0) *
+                      ((double)i / (NUM_OF_VELOCITIES - 1)) * ((double)i / (NUM_OF_VELOCITIES - 1)));
+    layer_map[i] = i * layers / NUM_OF_VELOCITIES;
+  }
+
+  printf("/* Generated by Tools/gen_bursts.c. Do not edit. */\n\n");
+  printf("#ifndef __EXCITATION_BURSTS_H\n");
+  printf("#define __EXCITATION_BURSTS_H\n\n");
+  printf("#define EXCITATION_VARIANTS  %ldU\n", variants);
+  printf("#define EXCITATION_LAYERS    %ldU\n", layers);
+  printf("#define EXCITATION_LENGTH    %ldU\n\n", length);
+  print_curve("uint16_t", "excitation_velocity_gains", gains);
+  print_curve("uint8_t", "excitation_velocity_layers", layer_map);
+  printf("static const int16_t excitation_bursts[%ld][%ld][%ld] = {\n", variants, layers, length);
+  for (v = 0; v < variants; ++v) {
+    printf("  {\n");
+    for (l = 0; l < layers; ++l) {
+      out = &bank[(v * layers + l) * length];
+      printf("    {\n");
+      for (i = 0; i < length; ++i) {
+        if ((i % 8) == 0) {
+          printf("      ");
+        }
+        printf("%ld%s", out[i], (i == length - 1) ? "\n" : (((i % 8) == 7) ? ",\n" : ", "));
+      }
+      printf("    }%s\n", (l == layers - 1) ? "" : ",");
+    }
+    printf("  }%s\n", (v == variants - 1) ? "" : ",");
+  }
+  printf("};\n\n");
+  printf("#endif /* __EXCITATION_BURSTS_H */\n");
+
+  free(noise);
+  free(burst);
+  free(bank);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2019 Ray Santana
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Host program that generates the note tables for the Karplus-Strong
+   model. It is run by the Makefile before the firmware is compiled:
+
+     gen_tables <sample rate> <A4 pitch> <equal|just|pythagorean> <T60 A0> <T60 C8> <release T60>
+                <bend range>
+
+   and writes note_tables.h to stdout. The decay time of the keys in
+   between is interpolated on a log scale. The bend range is the number
+   of semitones the pitch wheel bends the notes up or down. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_OF_NOTES      88
+#define MIDI_NOTE_OFFSET  108
+#define MIDI_NOTE_A4      69
+#define MIDI_NOTE_C4      60
+
+/* Largest loop gain that fits in Q15 */
+#define MAX_LOOP_GAIN     (32767.0 / 32768.0)
+
+/* The pitch wheel tables have an entry for every value of the MSB plus
+   one for the top end */
+#define NUM_OF_BEND_STEPS 128
+
+/* Ratios of each pitch class to C for the tuning systems that are not
+   equal tempered */
+static const double just_ratios[12] = {
+  1.0,       16.0/15.0, 9.0/8.0,   6.0/5.0,   5.0/4.0,   4.0/3.0,
+  45.0/32.0, 3.0/2.0,   8.0/5.0,   5.0/3.0,   9.0/5.0,   15.0/8.0
+};
+
+static const double pythagorean_ratios[12] = {
+  1.0,         256.0/243.0, 9.0/8.0,     32.0/27.0,   81.0/64.0,  4.0/3.0,
+  729.0/512.0, 3.0/2.0,     128.0/81.0,  27.0/16.0,   16.0/9.0,   243.0/128.0
+};
+
+
+/* Frequency of a MIDI note for the selected tuning system */
+static double note_frequency(int note, double a4_pitch, const double *ratios) {
+  int pitch_class;
+  int octave;
+
+  if (ratios == NULL) {
+    return a4_pitch * pow(2.0, (note - MIDI_NOTE_A4) / 12.0);
+  }
+
+  /* Ratios are relative to C, and A4 keeps the reference pitch */
+  pitch_class = ((note - MIDI_NOTE_C4) % 12 + 12) % 12;
+  octave = (note - MIDI_NOTE_C4 - pitch_class) / 12;
+  return a4_pitch / ratios[MIDI_NOTE_A4 - MIDI_NOTE_C4] * ratios[pitch_class] * pow(2.0, octave);
+}
+
+/* Magnitude of the two-tap filter (1 - a) + a z^-1 at omega */
+static double two_tap_gain(double a, double omega) {
+  return sqrt(1.0 - 2.0 * a * (1.0 - a) * (1.0 - cos(omega)));
+}
+
+/* Phase delay in samples of the two-tap filter (1 - a) + a z^-1 at omega */
+static double two_tap_delay(double a, double omega) {
+  return atan2(a * sin(omega), 1.0 - a + a * cos(omega)) / omega;
+}
+
+/* Two-tap weight whose filter has the given magnitude at omega, limited
+   to the range from 0 (no loss) to one half (the most loss) */
+static double two_tap_weight(double gain, double omega) {
+  double x;
+
+  if (gain >= 1.0) {
+    return 0.0;
+  }
+
+  x = (1.0 - gain * gain) / (2.0 * (1.0 - cos(omega)));
+  if (x >= 0.25) {
+    return 0.5;
+  }
+  return 0.5 * (1.0 - sqrt(1.0 - 4.0 * x));
+}
+
+/* Split the delay of one period into the integer delay line and the
+   fractional delays of the stretching filter and the interpolation */
+static void solve_delay(double period, double omega, double stretch, long *delay, long *frac_coeff) {
+  double frac;
+  double t;
+
+  *delay = (long)floor(period - two_tap_delay(stretch, omega));
+  frac = period - two_tap_delay(stretch, omega) - (double)*delay;
+
+  /* Solve the interpolation coefficient for the phase delay at the
+     fundamental */
+  t = tan(frac * omega);
+  frac = t / (sin(omega) + t * (1.0 - cos(omega)));
+  *frac_coeff = lround(frac * 16384.0);
+  if (*frac_coeff > 16383) {
+    *frac_coeff = 16383;
+  }
+}
+
+/* Q15 loop gain that gives a per period gain at the fundamental on top
+   of the losses of the loop filter */
+static long loop_gain(double period_gain, double filter_gain) {
+  long gain = lround(period_gain / filter_gain * 32768.0);
+
+  return (gain > 32767) ? 32767 : gain;
+}
+
+static void print_table(const char *type, const char *name, const long *values, int width) {
+  char entry[16];
+  int i;
+
+  printf("static const %s %s[%d] = {\n", type, name, NUM_OF_NOTES);
+  for (i = 0; i < NUM_OF_NOTES; ++i) {
+    if ((i % 8) == 0) {
+      printf("  ");
+    }
+
+    if (i == (NUM_OF_NOTES - 1)) {
+      printf("%ld\n", values[i]);
+    } else if ((i % 8) == 7) {
+      printf("%ld,\n", values[i]);
+    } else {
+      snprintf(entry, sizeof(entry), "%ld,", values[i]);
+      printf("%-*s", width, entry);
+    }
+  }
+  printf("};\n\n");
+}
+
+static void print_bend_table(long values[][NUM_OF_BEND_STEPS + 1]) {
+  int i;
+  int j;
+
+  printf("static const uint32_t note_bend_delays[%d][%d] = {\n", NUM_OF_NOTES, NUM_OF_BEND_STEPS + 1);
+  for (i = 0; i < NUM_OF_NOTES; ++i) {
+    printf("  {\n");
+    for (j = 0; j <= NUM_OF_BEND_STEPS; ++j) {
+      if ((j % 8) == 0) {
+        printf("    ");
+      }
+      printf("%ld%s", values[i][j], (j == NUM_OF_BEND_STEPS) ? "\n" : (((j % 8) == 7) ? ",\n" : ", "));
+    }
+    printf((i == (NUM_OF_NOTES - 1)) ? "  }\n" : "  },\n");
+  }
+  printf("};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+  long delays[NUM_OF_NOTES];
+  long frac_coeffs[NUM_OF_NOTES];
+  long stretch_coeffs[NUM_OF_NOTES];
+  long loss_coeffs[NUM_OF_NOTES];
+  long release_coeffs[NUM_OF_NOTES];
+  static long bend_delays[NUM_OF_NOTES][NUM_OF_BEND_STEPS + 1];
+  const double *ratios = NULL;
+  double sample_rate;
+  double a4_pitch;
+  double low_decay_time;
+  double high_decay_time;
+  double decay_time;
+  double release_time;
+  double bend_range;
+  double bent_period;
+  double period;
+  double omega;
+  double period_gain;
+  double filter_gain;
+  double stretch;
+  long max_delay = 0;
+  long max_bent_delay = 0;
+  long bent_delay;
+  long bent_frac;
+  int step;
+  int pass;
+  int i;
+
+  if (argc != 8) {
+    fprintf(stderr, "usage: %s <sample rate> <A4 pitch> <equal|just|pythagorean> <T60 A0> <T60 C8> "
+            "<release T60> <bend range>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  sample_rate = atof(argv[1]);
+  a4_pitch = atof(argv[2]);
+  low_decay_time = atof(argv[4]);
+  high_decay_time = atof(argv[5]);
+  release_time = atof(argv[6]);
+  bend_range = atof(argv[7]);
+  if (strcmp(argv[3], "just") == 0) {
+    ratios = just_ratios;
+  } else if (strcmp(argv[3], "pythagorean") == 0) {
+    ratios = pythagorean_ratios;
+  } else if (strcmp(argv[3], "equal") != 0) {
+    fprintf(stderr, "unknown tuning system: %s\n", argv[3]);
+    return EXIT_FAILURE;
+  }
+
+  if ((sample_rate <= 0.0) || (a4_pitch <= 0.0) || (low_decay_time <= 0.0) || (high_decay_time <= 0.0) ||
+      (release_time <= 0.0) || (bend_range < 0.0) || (bend_range > 12.0)) {
+    fprintf(stderr, "sample rate, pitch, decay time and release time must be positive and the bend "
+            "range at most 12 semitones\n");
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < NUM_OF_NOTES; ++i) {
+    omega = 2.0 * M_PI * note_frequency(MIDI_NOTE_OFFSET - i, a4_pitch, ratios) / sample_rate;
+    period = 2.0 * M_PI / omega;
+
+    decay_time = low_decay_time * pow(high_decay_time / low_decay_time,
+                                      (double)(NUM_OF_NOTES - 1 - i) / (NUM_OF_NOTES - 1));
+    period_gain = pow(10.0, -3.0 * period / (sample_rate * decay_time));
+
+    /* Start from the plain averaging filter. When it loses more per
+       period than the decay time allows, stretch the decay by moving
+       the weight of the filter towards the newest sample instead. The
+       stretch factor changes the delay of the filter and the delay
+       changes the interpolation, so the solution is refined a few times */
+    stretch = 0.5;
+    for (pass = 0; pass < 4; ++pass) {
+      solve_delay(period, omega, stretch, &delays[i], &frac_coeffs[i]);
+      filter_gain = two_tap_gain(frac_coeffs[i] / 16384.0, omega);
+      stretch = two_tap_weight(period_gain / (MAX_LOOP_GAIN * filter_gain), omega);
+      stretch_coeffs[i] = lround(stretch * 32768.0);
+      stretch = stretch_coeffs[i] / 32768.0;
+    }
+    solve_delay(period, omega, stretch, &delays[i], &frac_coeffs[i]);
+    filter_gain = two_tap_gain(frac_coeffs[i] / 16384.0, omega) * two_tap_gain(stretch, omega);
+
+    /* Loop gain that makes the string lose 60 dB over the decay time
+       on top of the losses of the loop filter */
+    loss_coeffs[i] = loop_gain(period_gain, filter_gain);
+
+    /* Same for the heavier damping once the key is released */
+    release_coeffs[i] = loop_gain(pow(10.0, -3.0 * period / (sample_rate * release_time)), filter_gain);
+
+    if (delays[i] < 2) {
+      fprintf(stderr, "sample rate is too low for note %d\n", MIDI_NOTE_OFFSET - i);
+      return EXIT_FAILURE;
+    }
+    if (delays[i] > max_delay) {
+      max_delay = delays[i];
+    }
+
+    /* Q14 loop delay D * 16384 + c for every pitch wheel MSB, solved
+       the same way as the unbent delay so that the firmware only has to
+       interpolate between two entries. The middle entry is the unbent
+       delay, and both ends have to fit in the delay line */
+    for (step = 0; step <= NUM_OF_BEND_STEPS; ++step) {
+      bent_period = period * pow(2.0, -bend_range * (step - NUM_OF_BEND_STEPS / 2) /
+                                      (NUM_OF_BEND_STEPS / 2) / 12.0);
+      solve_delay(bent_period, 2.0 * M_PI / bent_period, stretch, &bent_delay, &bent_frac);
+      bend_delays[i][step] = bent_delay * 16384 + bent_frac;
+    }
+    if ((bend_delays[i][0] / 16384) > max_bent_delay) {
+      max_bent_delay = bend_delays[i][0] / 16384;
+    }
+    if ((bend_delays[i][NUM_OF_BEND_STEPS] / 16384) < 2) {
+      fprintf(stderr, "bend range is too wide for note %d at this sample rate\n", MIDI_NOTE_OFFSET - i);
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("/* Generated by Tools/gen_tables.c. Do not edit. */\n\n");
+  printf("#ifndef __NOTE_TABLES_H\n");
+  printf("#define __NOTE_TABLES_H\n\n");
+  printf("#define NOTE_TABLES_SAMPLE_FREQUENCY  %luU\n", lround(sample_rate));
+  printf("#define NOTE_MAX_DELAY                %ldU\n", max_delay);
+  printf("#define NOTE_MAX_BENT_DELAY           %ldU\n\n", max_bent_delay);
+  print_table("uint16_t", "note_delay_lengths", delays, 6);
+  print_table("uint16_t", "note_frac_coeffs", frac_coeffs, 7);
+  print_table("uint16_t", "note_stretch_coeffs", stretch_coeffs, 7);
+  print_table("uint16_t", "note_loss_coeffs", loss_coeffs, 7);
+  print_table("uint16_t", "note_release_coeffs", release_coeffs, 7);
+  print_bend_table(bend_delays);
+  printf("#endif /* __NOTE_TABLES_H */\n");
+
+  return EXIT_SUCCESS;
+}